@@ -1,7 +1,9 @@
 #pragma once
 
+#include "LoadedProgram.hpp"
 #include "RAMController.hpp"
 #include "RegisterFile.hpp"
+#include "StateDump.hpp"
 
 #include <ShISA/Binary.hpp>
 #include <ShISA/ISAModule.hpp>
@@ -9,25 +11,30 @@
 
 #include <array>
 #include <concepts>
+#include <cstring>
 #include <iomanip>
 #include <limits>
+#include <memory>
 #include <ostream>
 #include <ranges>
+#include <span>
 
 
 
 namespace shisa::fsim {
 
-template <typename reg_t, typename addr_t, typename cell_t, size_t nRegs>
+template <typename reg_t, typename addr_t, typename cell_t, size_t nRegs,
+          class ram_t = RAMBase<addr_t, cell_t>>
 requires(std::unsigned_integral<reg_t> &&std::unsigned_integral<addr_t>
              &&std::unsigned_integral<cell_t>) class CpuBase {
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
+  using RAM  = ram_t;
 
   using RegisterFile  = RegisterFileBase<Reg, nRegs>;
-  using RAMController = RAMControllerBase<Addr, Cell>;
+  using RAMController = RAMControllerBase<Addr, Cell, RAM>;
 
   constexpr static size_t NREGS = nRegs;
 
@@ -49,11 +56,68 @@ private:
 
   bool reachEnd = true;
 
+  // first watched store of the current instruction, reported by
+  // checkWatchpoints() once the instruction is complete
+  bool watchpointHit = false;
+  Addr watchAddr     = 0;
+  Reg  watchOldData  = 0;
+  Reg  watchNewData  = 0;
+
+  void recordWatchpointHit(Addr addr, Reg oldData, Reg newData) {
+    if (watchpointHit) {
+      return;
+    }
+    watchpointHit = true;
+    watchAddr     = addr;
+    watchOldData  = oldData;
+    watchNewData  = newData;
+  }
+
+  void storeWord(Addr addr, Reg data) {
+    if constexpr (RAMController::template hasWordPath<Reg>) {
+      RAMControl.writeWord(addr, data);
+      return;
+    }
+    for (size_t i = 0; i < cellsPerReg; i++) {
+      size_t shift    = cellsPerReg - i - 1;
+      Cell   cellData = data >> (shift * sizeof(Cell) * CHAR_BIT);
+      RAMControl.write(addr + i, cellData);
+    }
+  }
+
+  void writeWatchedWordToRAM(Addr addr, Reg data) {
+    const Reg oldData = readWordFromRAM(addr);
+    storeWord(addr, data);
+    for (size_t i = 0; i < cellsPerReg; i++) {
+      if (RAMControl.isWatched(addr + i)) {
+        recordWatchpointHit(addr, oldData, readWordFromRAM(addr));
+        return;
+      }
+    }
+  }
+
+  [[nodiscard]] auto hashWithRAM(uint64_t ramHash) const -> uint64_t {
+    StateHasher hasher{};
+    for (const Reg reg : regFile) {
+      hasher.update(reg);
+    }
+    hasher.update(PC);
+    hasher.update(SP);
+    hasher.update(ramHash);
+    return hasher.digest();
+  }
+
 public:
   [[nodiscard]] auto getPC() const -> Addr { return PC; }
   [[nodiscard]] auto getProgramStart() const -> Addr {
     return RAMControl.getProgramStart();
   }
+  [[nodiscard]] auto getProgramEnd() const -> Addr {
+    return RAMControl.getProgramEnd();
+  }
+  [[nodiscard]] auto getBinEnd() const -> Addr {
+    return RAMControl.getBinEnd();
+  }
   [[nodiscard]] auto getSP() const -> Addr { return SP; }
   [[nodiscard]] auto endReached() const -> bool { return reachEnd; }
 
@@ -68,6 +132,16 @@ public:
     RAMControl.dump(os);
   }
 
+  // compact dumps of the state, see StateDump.hpp
+  void dumpBinary(std::ostream &os,
+                  DumpCells which = DumpCells::nonZero) const {
+    writeBinary(os, makeStateDump(*this, which));
+  }
+
+  void dumpText(std::ostream &os, DumpCells which = DumpCells::nonZero) const {
+    writeText(os, makeStateDump(*this, which));
+  }
+
   auto reg_begin() -> decltype(regFile.begin()) { return regFile.begin(); }
   auto reg_end() -> decltype(regFile.end()) { return regFile.end(); }
 
@@ -96,13 +170,23 @@ public:
 
   auto ram_range() const { return std::views::all(RAMControl); }
 
-  void loadBin(const Binary &b) {
+  void loadBin(BinaryView b) {
     RAMControl.loadBin(b);
     PC       = RAMControl.getProgramStart();
     SP       = RAMControl.getBinEnd();
     reachEnd = static_cast<bool>(PC >= RAMControl.getProgramEnd());
   }
 
+  // same as loadBin(), the RAM may keep sharing the image of program
+  void loadProgram(
+      const std::shared_ptr<const LoadedProgramBase<Addr, Cell>> &program) {
+    RAMControl.loadImage(program->getImage(), program->getDataEnd(),
+                         program->getBinEnd(), program);
+    PC       = RAMControl.getProgramStart();
+    SP       = RAMControl.getBinEnd();
+    reachEnd = static_cast<bool>(PC >= RAMControl.getProgramEnd());
+  }
+
   void PCIncrement() {
     PC += cellsPerInst;
     if (PC < RAMControl.getProgramEnd()) {
@@ -166,9 +250,23 @@ public:
   void writeReg(int r, Reg data) { regFile.write(r, data); }
 
   auto readFromRAM(Addr addr) const -> Cell { return RAMControl.read(addr); }
-  void writeToRAM(Addr addr, Cell data) { RAMControl.write(addr, data); }
+
+  void writeToRAM(Addr addr, Cell data) {
+    if (RAMControl.isPageWatched(addr)) [[unlikely]] {
+      const Cell oldData = RAMControl.read(addr);
+      RAMControl.write(addr, data);
+      if (RAMControl.isWatched(addr)) {
+        recordWatchpointHit(addr, oldData, RAMControl.read(addr));
+      }
+      return;
+    }
+    RAMControl.write(addr, data);
+  }
 
   auto readWordFromRAM(Addr addr) const -> Reg {
+    if constexpr (RAMController::template hasWordPath<Reg>) {
+      return RAMControl.template readWord<Reg>(addr);
+    }
     Reg res = 0;
     for (int i = 0; i < cellsPerReg; i++) {
       res |= static_cast<Reg>(RAMControl.read(addr + i))
@@ -178,13 +276,209 @@ public:
   }
 
   void writeWordToRAM(Addr addr, Reg data) {
-    for (int i = 0; i < cellsPerReg; i++) {
-      size_t shift    = cellsPerReg - i - 1;
-      Cell   cellData = data >> (shift * sizeof(Cell) * CHAR_BIT);
-      RAMControl.write(addr + i, cellData);
+    if (RAMControl.isPageWatched(addr)) [[unlikely]] {
+      writeWatchedWordToRAM(addr, data);
+      return;
+    }
+    storeWord(addr, data);
+  }
+
+  void addWatchpoint(Addr addr, size_t size = 1) {
+    RAMControl.addWatchpoint(addr, size);
+  }
+
+  void removeWatchpoint(Addr addr, size_t size = 1) {
+    RAMControl.removeWatchpoint(addr, size);
+  }
+
+  void clearWatchpoints() {
+    RAMControl.clearWatchpoints();
+    watchpointHit = false;
+  }
+
+  void checkWatchpoints() {
+    if (watchpointHit) [[unlikely]] {
+      watchpointHit = false;
+      throw Watchpoint<Addr, Reg>{watchAddr, watchOldData, watchNewData};
+    }
+  }
+
+  // Brings the state back to image, a CPU with the same binary loaded,
+  // restoring the RAM pages written since then. Watchpoints are kept.
+  void resetTo(const CpuBase &image) {
+    regFile  = image.regFile;
+    PC       = image.PC;
+    SP       = image.SP;
+    reachEnd = image.reachEnd;
+    RAMControl.restoreDirtyPages(image.RAMControl);
+    watchpointHit = false;
+  }
+
+  // The state of parent with the RAM shared copy-on-write where the RAM
+  // can do it, see RAMController::forkFrom()
+  void forkFrom(CpuBase &parent) {
+    regFile  = parent.regFile;
+    PC       = parent.PC;
+    SP       = parent.SP;
+    reachEnd = parent.reachEnd;
+    RAMControl.forkFrom(parent.RAMControl);
+    watchpointHit = false;
+  }
+
+  // see RAMController::hashRAM(), the const one does not update the page
+  // hashes
+  [[nodiscard]] auto hashRAM() -> uint64_t { return RAMControl.hashRAM(); }
+
+  [[nodiscard]] auto hashRAM() const -> uint64_t {
+    return RAMControl.hashRAM();
+  }
+
+  // Hash of the registers, PC, SP and RAM. Costs a pass over the pages
+  // written since the last non-const call rather than over the whole RAM.
+  [[nodiscard]] auto stateHash() -> uint64_t {
+    return hashWithRAM(RAMControl.hashRAM());
+  }
+
+  [[nodiscard]] auto stateHash() const -> uint64_t {
+    return hashWithRAM(RAMControl.hashRAM());
+  }
+
+  // see RAMController::forEachSpan()
+  template <typename F>
+  void forEachRAMSpan(size_t first, size_t size, F f) const {
+    RAMControl.forEachSpan(first, size, f);
+  }
+
+  // see PagedRAM::deduplicate()
+  template <class Deduplicator>
+  void deduplicatePages(Deduplicator &dedup) {
+    RAMControl.deduplicate(dedup);
+  }
+
+  // see RAMController::loadData()
+  void loadData(std::span<const Binary::Data> data) {
+    RAMControl.loadData(data);
+  }
+
+  // pages of RAMController::pageSize cells written since the last
+  // clearDirtyPages(), see RAMController
+  [[nodiscard]] auto isPageDirty(Addr addr) const -> bool {
+    return RAMControl.isPageDirty(addr);
+  }
+
+  template <typename F>
+  void forEachDirtyPage(F f) const {
+    RAMControl.forEachDirtyPage(f);
+  }
+
+  void clearDirtyPages() { RAMControl.clearDirtyPages(); }
+
+  // Bulk versions of readWordFromRAM()/writeWordToRAM() over consecutive
+  // words with the same big-endian image. They return false without
+  // touching anything when the range can't be accessed at once, so the
+  // caller falls back to the word by word path.
+  auto readWordsFromRAM(Addr addr, std::span<Reg> words) const -> bool {
+    if constexpr (!RAMController::hasFlatStorage) {
+      return false;
+    } else {
+      if (!RAMController::isBulkReadable(addr, words.size() * cellsPerReg)) {
+        return false;
+      }
+      const Cell *src = RAMControl.data() + addr;
+      for (Reg &word : words) {
+        Reg res = 0;
+        for (size_t i = 0; i < cellsPerReg; i++) {
+          res |= static_cast<Reg>(src[i])
+                 << (cellsPerReg - i - 1) * sizeof(Cell) * CHAR_BIT;
+        }
+        word = res;
+        src += cellsPerReg;
+      }
+      return true;
+    }
+  }
+
+  [[nodiscard]] auto isBulkWritable(Addr addr, size_t size) const -> bool {
+    return RAMControl.isBulkWritable(addr, size);
+  }
+
+  auto writeWordsToRAM(Addr addr, std::span<const Reg> words) -> bool {
+    if constexpr (!RAMController::hasFlatStorage) {
+      return false;
+    } else {
+      if (!RAMControl.isBulkWritable(addr, words.size() * cellsPerReg)) {
+        return false;
+      }
+      Cell *dst = RAMControl.data() + addr;
+      for (const Reg word : words) {
+        for (size_t i = 0; i < cellsPerReg; i++) {
+          dst[i] = word >> (cellsPerReg - i - 1) * sizeof(Cell) * CHAR_BIT;
+        }
+        dst += cellsPerReg;
+      }
+      RAMControl.markDirty(addr, words.size() * cellsPerReg);
+      return true;
+    }
+  }
+
+  // Host transfers of whole buffers with one range check per call and a
+  // memcpy. Ranges that wrap around, cover the read-only binary or a
+  // watched page go cell by cell with the usual semantics.
+  void copyIn(Addr addr, std::span<const Cell> cells) {
+    if constexpr (RAMController::hasFlatStorage) {
+      if (!cells.empty() && RAMControl.isBulkWritable(addr, cells.size())) {
+        std::memcpy(RAMControl.data() + addr, cells.data(),
+                    cells.size_bytes());
+        RAMControl.markDirty(addr, cells.size());
+        return;
+      }
+    }
+    for (size_t i = 0; i < cells.size(); i++) {
+      writeToRAM(static_cast<Addr>(addr + i), cells[i]);
     }
   }
 
+  void copyOut(Addr addr, std::span<Cell> cells) const {
+    if constexpr (RAMController::hasFlatStorage) {
+      if (RAMController::isBulkReadable(addr, cells.size())) {
+        std::memcpy(cells.data(), RAMControl.data() + addr,
+                    cells.size_bytes());
+        return;
+      }
+    }
+    for (size_t i = 0; i < cells.size(); i++) {
+      cells[i] = readFromRAM(static_cast<Addr>(addr + i));
+    }
+  }
+
+  // big-endian words, as readWordFromRAM()/writeWordToRAM()
+  void copyWordsIn(Addr addr, std::span<const Reg> words) {
+    if (writeWordsToRAM(addr, words)) {
+      return;
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+      writeWordToRAM(static_cast<Addr>(addr + i * cellsPerReg), words[i]);
+    }
+  }
+
+  void copyWordsOut(Addr addr, std::span<Reg> words) const {
+    if (readWordsFromRAM(addr, words)) {
+      return;
+    }
+    for (size_t i = 0; i < words.size(); i++) {
+      words[i] = readWordFromRAM(static_cast<Addr>(addr + i * cellsPerReg));
+    }
+  }
+
+  // [addr, addr + size) in place, for parsing results without a copy. The
+  // range must not wrap around. The view is valid until the next loadBin().
+  [[nodiscard]] auto viewRAM(Addr addr, size_t size) const
+      -> std::span<const Cell> requires RAMController::hasFlatStorage {
+    SHISA_CHECK(RAMController::isBulkReadable(addr, size),
+                "RAM view wraps around the address space");
+    return {RAMControl.data() + addr, size};
+  }
+
   void readRegFromRAM(Addr addr, int r) {
     Reg data = readWordFromRAM(addr);
     regFile.write(r, data);
@@ -210,6 +504,8 @@ public:
     }
   }
 
+  void setSP(Addr addr) { SP = addr; }
+
   void setPCToEnd() {
     PC       = RAMControl.getProgramEnd();
     reachEnd = true;
@@ -225,27 +521,80 @@ public:
     SPIncrement();
   }
 
+  // Stack words with the bounds enforced by a protected RAM, see
+  // RAMControllerBase::storeStackWord(). A store to a watched page fails
+  // too, so the caller's checked path reports it.
+  auto tryStoreStackWord(Addr addr, Reg data) -> bool {
+    return !RAMControl.isPageWatched(addr) &&
+           RAMControl.storeStackWord(addr, data);
+  }
+
+  auto tryLoadStackWord(Addr addr, Reg &data) const -> bool {
+    return RAMControl.loadStackWord(addr, data);
+  }
+
   void loadRegFromStack(int r) {
+    if constexpr (RAMController::isProtected) {
+      Reg data = 0;
+      if (tryLoadStackWord(static_cast<Addr>(SP - cellsPerReg), data)) {
+        SP -= cellsPerReg;
+        regFile.write(r, data);
+        return;
+      }
+    }
     SPRegDecrement();
     readRegFromRAM(SP, r);
   }
 
   void storeRegOnStack(int r) {
+    if constexpr (RAMController::isProtected) {
+      if (tryStoreStackWord(SP, regFile.read(r))) {
+        SP += cellsPerReg;
+        return;
+      }
+    }
     writeRegToRAM(SP, r);
     SPRegIncrement();
   }
 
   void loadPCFromStack() {
+    if constexpr (RAMController::isProtected) {
+      Reg data = 0;
+      if (tryLoadStackWord(static_cast<Addr>(SP - cellsPerReg), data)) {
+        SP -= cellsPerReg;
+        setPC(data);
+        return;
+      }
+    }
     SPRegDecrement();
     setPC(readWordFromRAM(SP));
   }
 
   void storePCOnStack() {
+    if constexpr (RAMController::isProtected) {
+      if (tryStoreStackWord(SP, PC)) {
+        SP += cellsPerReg;
+        return;
+      }
+    }
     writeWordToRAM(SP, PC);
     SPRegIncrement();
   }
 
+  // r2..r15 are spilled and filled as one frame when it fits the stack, so
+  // the bounds are checked once instead of per register. Otherwise the
+  // per-register path reports overflow and underflow at the same register.
   void loadRegsFromStack() {
+    const size_t frameCells =
+        (NREGS - FIRST_WRITABLE_REG) * static_cast<size_t>(cellsPerReg);
+    if (SP >= RAMControl.getBinEnd() + frameCells) {
+      const Addr frame = SP - frameCells;
+      if (readWordsFromRAM(frame, std::span{regFile.begin(), regFile.end()})) {
+        SP = frame;
+        return;
+      }
+    }
+
     for (int r :
          std::views::iota(FIRST_WRITABLE_REG, NREGS) | std::views::reverse) {
       loadRegFromStack(r);
@@ -253,6 +602,14 @@ public:
   }
 
   void storeRegsOnStack() {
+    const size_t frameCells =
+        (NREGS - FIRST_WRITABLE_REG) * static_cast<size_t>(cellsPerReg);
+    if (SP + frameCells <= RAMControl.getBinEnd() + STACK_OFFSET &&
+        writeWordsToRAM(SP, std::span{regFile.begin(), regFile.end()})) {
+      SP += frameCells;
+      return;
+    }
+
     for (int r : std::views::iota(FIRST_WRITABLE_REG, NREGS)) {
       storeRegOnStack(r);
     }
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "EventQueue.hpp"
+#include "ProgramFile.hpp"
+#include "StateDump.hpp"
+
+#include <exceptions.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+
+// Checkpoints of a running sim: its CPU state, the number of retired
+// instructions and the scheduled events in a file, written in the
+// background while the sim goes on running and mapped back on restore.
+//
+// File format, integers little-endian:
+//   "ShISAckp", u32 version, u64 retired instructions, u64 CpuBase::
+//   stateHash() of the state, u64 number of events, per event u64 deadline,
+//   entry and period in the order they are due, then the state as a
+//   StateDump in the binary format, with the non-zero cells of the RAM.
+//
+// A checkpoint is restored into any sim of the same program, which is
+// reset first, so the cells the checkpoint does not hold are zero. The
+// whole file is validated before the sim is written, but for the state
+// hash, which is checked after the restore. So a checkpoint of another
+// program is rejected with the sim untouched, and a corrupt file with the
+// sim reset.
+
+
+
+namespace shisa::fsim {
+
+namespace checkpoint_detail {
+
+constexpr std::string_view magic   = "ShISAckp";
+constexpr uint32_t         version = 2;
+
+inline void writeAll(int fd, std::string_view bytes) {
+  while (!bytes.empty()) {
+    const ssize_t n = ::write(fd, bytes.data(), bytes.size());
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    SHISA_CHECK(n > 0, "can't write the checkpoint");
+    bytes.remove_prefix(static_cast<size_t>(n));
+  }
+}
+
+} // namespace checkpoint_detail
+
+// what a checkpoint holds besides the CPU state, both in retired
+// instructions
+template <typename Addr>
+struct CheckpointTiming {
+  uint64_t                                          retired = 0;
+  std::vector<typename EventQueueBase<Addr>::Event> events{};
+};
+
+// Writes the checkpoint of sim. The file is written beside path, synced and
+// renamed over it, so path holds either the previous checkpoint or this
+// one.
+template <class Sim>
+void saveCheckpoint(const std::string &path, const Sim &sim) {
+  const auto &cpu = sim.getState();
+
+  std::string buf{checkpoint_detail::magic};
+  dump_detail::putLE(buf, checkpoint_detail::version, 4);
+  dump_detail::putLE(buf, sim.retiredInsts(), 8);
+  dump_detail::putLE(buf, cpu.stateHash(), 8);
+  const auto events = sim.pendingEvents();
+  dump_detail::putLE(buf, events.size(), 8);
+  for (const auto &event : events) {
+    dump_detail::putLE(buf, event.deadline, 8);
+    dump_detail::putLE(buf, event.entry, 8);
+    dump_detail::putLE(buf, event.period, 8);
+  }
+  buf += encodeBinary(makeStateDump(cpu));
+
+  const std::string tmp = path + ".tmp";
+  const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+  SHISA_CHECK(fd != -1, "can't create " + tmp);
+  try {
+    checkpoint_detail::writeAll(fd, buf);
+    SHISA_CHECK(fsync(fd) == 0, "can't sync " + tmp);
+  } catch (...) {
+    close(fd);
+    std::remove(tmp.c_str());
+    throw;
+  }
+  close(fd);
+  SHISA_CHECK(std::rename(tmp.c_str(), path.c_str()) == 0,
+              "can't rename " + tmp);
+}
+
+// Loads the checkpoint at path into cpu, which has the same program loaded.
+// Once the file is validated, reset(cpu) brings cpu to the state right
+// after loading the program, and again if the restored state does not
+// match the checkpoint. The file is mapped and the cells are copied from
+// the mapping. Returns the retired instructions and the events.
+template <class CPU, typename F>
+[[nodiscard]] auto loadCheckpoint(const std::string &path, CPU &cpu, F reset)
+    -> CheckpointTiming<typename CPU::Addr> {
+  using Addr = typename CPU::Addr;
+  using Cell = typename CPU::Cell;
+
+  const MappedFile         file{path};
+  dump_detail::BytesReader in{file.bytes()};
+
+  std::string magic(checkpoint_detail::magic.size(), '\0');
+  in.read(magic.data(), magic.size());
+  SHISA_CHECK(magic == checkpoint_detail::magic, path + ": not a checkpoint");
+  SHISA_CHECK(in.getLE(4) == checkpoint_detail::version,
+              path + ": unsupported checkpoint version");
+  CheckpointTiming<Addr> timing{};
+  timing.retired      = in.getLE(8);
+  const uint64_t hash = in.getLE(8);
+
+  const uint64_t nEvents = in.getLE(8);
+  for (uint64_t i = 0; i < nEvents; i++) {
+    auto &event      = timing.events.emplace_back();
+    event.deadline   = in.getLE(8);
+    const auto entry = in.getLE(8);
+    SHISA_CHECK(entry <= std::numeric_limits<Addr>::max(),
+                path + ": event entry out of the RAM");
+    event.entry  = static_cast<Addr>(entry);
+    event.period = in.getLE(8);
+  }
+
+  // the data section is written as a whole by CPU::loadData(), the rest
+  // of the binary is read-only and already in place
+  const Addr        dataEnd = cpu.getProgramStart();
+  const Addr        binEnd  = cpu.getBinEnd();
+  std::vector<Cell> dataCells(dataEnd);
+  std::vector<Cell> cells{};
+
+  // The dump is read twice, checked first so that a bad one is rejected
+  // before anything is written into cpu. The cells are skipped then.
+  const auto checkRun = [&](uint64_t addr, uint64_t nCells, size_t cellBytes,
+                            dump_detail::BytesReader &r) {
+    SHISA_CHECK(cellBytes == sizeof(Cell) && addr <= CPU::RAM::nCells &&
+                    nCells <= CPU::RAM::nCells - addr,
+                path + ": cells out of the RAM");
+    (void)r.take(nCells * cellBytes);
+  };
+  dump_detail::BytesReader checkIn = in;
+  const StateDump          dump    = dump_detail::readDump(checkIn, checkRun);
+  SHISA_CHECK(dump.regBytes == sizeof(typename CPU::Reg) &&
+                  dump.addrBytes == sizeof(Addr) &&
+                  dump.regs.size() == CPU::NREGS && dump.binEnd == binEnd,
+              path + ": checkpoint of another CPU or program");
+
+  reset(cpu);
+  const auto restoreRun = [&](uint64_t addr, uint64_t nCells,
+                              size_t cellBytes, dump_detail::BytesReader &r) {
+    const auto bytes = r.take(nCells * cellBytes);
+    if constexpr (sizeof(Cell) == 1) {
+      cells.assign(reinterpret_cast<const Cell *>(bytes.data()),
+                   reinterpret_cast<const Cell *>(bytes.data()) + nCells);
+    } else {
+      dump_detail::BytesReader cellsIn{bytes};
+      cells.resize(nCells);
+      for (Cell &cell : cells) {
+        cell = static_cast<Cell>(cellsIn.getLE(cellBytes));
+      }
+    }
+    for (size_t i = 0; i < nCells && addr + i < dataEnd; i++) {
+      dataCells[addr + i] = cells[i];
+    }
+    if (addr + nCells > binEnd) {
+      const size_t skip = addr < binEnd ? binEnd - addr : 0;
+      cpu.copyIn(static_cast<Addr>(addr + skip),
+                 std::span<const Cell>{cells}.subspan(skip));
+    }
+  };
+  (void)dump_detail::readDump(in, restoreRun);
+
+  std::vector<Binary::Data> data(dataEnd / CPU::RAMController::cellsPerData);
+  for (size_t w = 0; w < data.size(); w++) {
+    for (size_t i = 0; i < CPU::RAMController::cellsPerData; i++) {
+      data[w] = static_cast<Binary::Data>(
+          data[w] << (sizeof(Cell) * CHAR_BIT) |
+          dataCells[w * CPU::RAMController::cellsPerData + i]);
+    }
+  }
+  cpu.loadData(data);
+  for (size_t r = 0; r < dump.regs.size(); r++) {
+    cpu.writeReg(static_cast<int>(r),
+                 static_cast<typename CPU::Reg>(dump.regs[r]));
+  }
+  cpu.setPC(static_cast<Addr>(dump.PC));
+  cpu.setSP(static_cast<Addr>(dump.SP));
+
+  if (cpu.stateHash() != hash) {
+    reset(cpu);
+    SHISA_THROW(path + ": restored state differs from the checkpoint");
+  }
+  return timing;
+}
+
+// Same as loadCheckpoint() for a sim, which is reset with SimBase::reset()
+// and may have run before, see SimBase::restoreState(). The events of the
+// checkpoint replace the ones of sim, its watchpoints are dropped.
+template <class Sim>
+void restoreCheckpoint(const std::string &path, Sim &sim) {
+  std::vector<typename Sim::Event> events{};
+  sim.restoreState([&path, &events, &sim](typename Sim::CPU &cpu) {
+    auto timing = loadCheckpoint(path, cpu,
+                                 [&sim](typename Sim::CPU &) { sim.reset(); });
+    events      = std::move(timing.events);
+    return timing.retired;
+  });
+  sim.clearEvents();
+  for (const auto &event : events) {
+    sim.scheduleEvent(event.deadline, event.entry, event.period);
+  }
+}
+
+// Writes checkpoints of a sim in the background. save() forks the sim,
+// which shares the RAM pages copy-on-write where the RAM can, and returns,
+// so the sim runs on while the fork is written. Checkpoints are written
+// one at a time. The fork is dropped as soon as its file is written, so
+// the sim copies the pages it writes only while a checkpoint is written.
+template <class Sim>
+class CheckpointWriter {
+  std::future<void> pending{};
+
+public:
+  CheckpointWriter() = default;
+
+  CheckpointWriter(const CheckpointWriter &)                     = delete;
+  auto operator=(const CheckpointWriter &) -> CheckpointWriter & = delete;
+
+  // A destructor can't throw, so the error of the last checkpoint is
+  // reported on std::cerr. Call wait() first to handle it.
+  ~CheckpointWriter() {
+    try {
+      wait();
+    } catch (const std::exception &e) {
+      std::cerr << "CheckpointWriter: " << e.what() << '\n';
+    }
+  }
+
+  // Waits for the previous checkpoint, then forks sim. Must not race with
+  // sim running, e.g. is called between runs by the thread running it.
+  // Only RAM like PagedRAM forks in the time of a page table copy, any
+  // other one, RAMBase too, is copied whole by the calling thread.
+  void save(Sim &sim, std::string path) {
+    wait();
+    pending = std::async(
+        std::launch::async,
+        [snapshot = sim.fork(), p = std::move(path)]() mutable {
+          // the task state keeps the lambda up to the next wait()
+          const auto fork = std::move(snapshot);
+          saveCheckpoint(p, *fork);
+        });
+  }
+
+  // Waits for the checkpoint being written and throws its error, if any.
+  void wait() {
+    if (pending.valid()) {
+      pending.get();
+    }
+  }
+};
+
+} // namespace shisa::fsim
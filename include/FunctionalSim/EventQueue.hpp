@@ -0,0 +1,85 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <vector>
+
+
+
+namespace shisa::fsim {
+
+template <typename addr_t>
+requires(std::unsigned_integral<addr_t>) class EventQueueBase {
+public:
+  using Addr = addr_t;
+  // events are scheduled in retired instructions, which keeps them
+  // deterministic regardless of the host speed
+  using Tick = uint64_t;
+
+  static constexpr Tick never = std::numeric_limits<Tick>::max();
+
+  struct Event {
+    Tick     deadline;
+    Addr     entry;
+    Tick     period; // zero for one-shot events
+    uint64_t seq;    // keeps events with the same deadline in FIFO order
+  };
+
+private:
+  struct Later {
+    auto operator()(const Event &lhs, const Event &rhs) const -> bool {
+      if (lhs.deadline != rhs.deadline) {
+        return lhs.deadline > rhs.deadline;
+      }
+      return lhs.seq > rhs.seq;
+    }
+  };
+
+  std::priority_queue<Event, std::vector<Event>, Later> events{};
+
+  uint64_t nextSeq = 0;
+
+public:
+  void schedule(Tick deadline, Addr entry, Tick period = 0) {
+    events.push(Event{deadline, entry, period, nextSeq++});
+  }
+
+  [[nodiscard]] auto nextDeadline() const -> Tick {
+    return events.empty() ? never : events.top().deadline;
+  }
+
+  [[nodiscard]] auto isDue(Tick now) const -> bool {
+    return nextDeadline() <= now;
+  }
+
+  // Removes the earliest event and reschedules it if it is periodic.
+  auto pop() -> Event {
+    Event event = events.top();
+    events.pop();
+    if (event.period != 0) {
+      schedule(event.deadline + event.period, event.entry, event.period);
+    }
+    return event;
+  }
+
+  // the events in the order they are due
+  [[nodiscard]] auto pending() const -> std::vector<Event> {
+    auto               queue = events;
+    std::vector<Event> due{};
+    due.reserve(queue.size());
+    for (; !queue.empty(); queue.pop()) {
+      due.push_back(queue.top());
+    }
+    return due;
+  }
+
+  [[nodiscard]] auto size() const -> size_t { return events.size(); }
+
+  [[nodiscard]] auto empty() const -> bool { return events.empty(); }
+
+  void clear() { events = {}; }
+};
+
+} // namespace shisa::fsim
@@ -0,0 +1,547 @@
+#pragma once
+
+#include <FunctionalSim/Sim.hpp>
+#include <ShISA/ISAModule.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ranges>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+
+// Define to 1 to count the hits and misses of the HoistedSim jump cache,
+// see HoistedSim::getJumpCacheStats(). The counters are in the dispatch
+// loop, so they are off by default.
+#ifndef SHISA_JUMP_CACHE_STATS
+#define SHISA_JUMP_CACHE_STATS 0
+#endif
+
+
+
+namespace shisa::fsim {
+
+// Predecoded engine whose run loop keeps the instruction index, SP and the
+// register file in host locals. They are written back to the CPU state only
+// at stop points: end of run, exceptions, events and stop requests.
+template <typename reg_t = uint16_t, typename addr_t = uint16_t,
+          typename cell_t = uint8_t, size_t nRegs = NREGS,
+          class ram_t = RAMBase<addr_t, cell_t>>
+class HoistedSim final
+    : public SimBase<reg_t, addr_t, cell_t, nRegs, ram_t> {
+public:
+  using Reg  = reg_t;
+  using Addr = addr_t;
+  using Cell = cell_t;
+
+  using Sim     = SimBase<Reg, Addr, Cell, nRegs, ram_t>;
+  using CPU     = typename Sim::CPU;
+  using Program = typename Sim::Program;
+
+  USING_SIM_BASE(Sim);
+
+private:
+  // writes to r0 and r1 are redirected to this extra register
+  static constexpr int sinkReg = nRegs;
+
+  static constexpr size_t nSavedRegs = nRegs - FIRST_WRITABLE_REG;
+  static constexpr size_t frameSize  = (nSavedRegs + 1) * CPU::cellsPerReg;
+
+  using Regs = std::array<Reg, nRegs + 1>;
+
+public:
+  struct JumpCacheStats {
+    uint64_t hits   = 0;
+    uint64_t misses = 0;
+  };
+
+  static constexpr bool countsJumps = SHISA_JUMP_CACHE_STATS != 0;
+
+private:
+  // Per-site monomorphic cache of the last taken JTR or CALL target and the
+  // instruction index it resolves to. A hit skips the range check and the
+  // address to index conversion.
+  struct JumpCacheEntry {
+    Reg    target;
+    size_t idx;
+  };
+
+  // The predecoded program with the writes to r0 and r1 sent to sinkReg,
+  // built once per program and shared by its sims. JTR and CALL carry the
+  // index of their jump cache entry in the operand they don't use: dst of
+  // JTR and srcL of CALL.
+  struct Translation {
+    std::vector<shisa::Inst::DecodedInst> insts;
+    size_t                                nJumpSites = 0;
+  };
+
+  std::shared_ptr<const Translation> translation;
+  std::vector<JumpCacheEntry>        jumpCache{};
+  JumpCacheStats                     jumpCacheStats{};
+
+  static auto translate(const Program &program) -> Translation {
+    Translation code{};
+    code.insts.reserve(program.getDecoded().size());
+    for (auto decoded : program.getDecoded()) {
+      if (writesDst(decoded.opCode) &&
+          decoded.dst < static_cast<int>(FIRST_WRITABLE_REG)) {
+        decoded.dst = sinkReg;
+      }
+      if (decoded.opCode == OpCode::JTR) {
+        decoded.dst = static_cast<int>(code.nJumpSites++);
+      } else if (decoded.opCode == OpCode::CALL) {
+        decoded.srcL = static_cast<int>(code.nJumpSites++);
+      }
+      code.insts.push_back(decoded);
+    }
+    return code;
+  }
+
+  // Host copies of the frames stored by CALL. The first liveFrames entries
+  // are the frames on the guest stack: one is dropped as soon as a store may
+  // have overwritten it, so RET can take the registers and the return index
+  // from the top one instead of reading the guest stack.
+  //
+  // Frames are written to guest RAM lazily. A frame that is not written yet
+  // stays in the vector after its RET, so a CALL storing the same frame
+  // slot again just replaces it. All unwritten frames are written out as
+  // soon as the guest accesses memory near them and at every point where
+  // the CPU state becomes visible. SPs grow strictly along the vector.
+  struct ShadowFrame {
+    Addr                        SP; // SP right after the frame was stored
+    size_t                      retIdx;
+    std::array<Reg, nSavedRegs> regs;
+    bool                        written;
+  };
+
+  std::vector<ShadowFrame> shadowStack{};
+  size_t                   liveFrames = 0;
+
+  static auto writesDst(OpCode op) -> bool {
+    switch (op) {
+    case OpCode::JTR:
+    case OpCode::ST:
+    case OpCode::PUSH:
+    case OpCode::CALL:
+    case OpCode::RET:
+      return false;
+    default:
+      return true;
+    }
+  }
+
+  template <bool singleStep>
+  void run() {
+    auto &state = getState();
+    if (state.endReached()) {
+      if (singleStep) {
+        throw ProgramEnd{};
+      }
+      return;
+    }
+
+    const auto  *insts        = translation->insts.data();
+    const size_t nInsts       = translation->insts.size();
+    const Addr   programStart = state.getProgramStart();
+    const size_t programEnd   = state.getProgramEnd();
+    const size_t stackBegin   = state.getBinEnd();
+    const size_t stackEnd     = stackBegin + STACK_OFFSET;
+
+    shadowStack.clear();
+    liveFrames = 0;
+
+    // covers all the unwritten frames
+    size_t lazyBegin = std::numeric_limits<size_t>::max();
+    size_t lazyEnd   = 0;
+
+    Regs   regs{};
+    size_t idx      = 0;
+    size_t blockIdx = 0;
+    Addr   SP       = 0;
+    // PC may be misaligned after a slow path jump. Such PC executes the
+    // instruction it points into, but the last one is out of the program.
+    Addr   skew   = 0;
+    size_t idxEnd = nInsts;
+
+    auto savedRegs = [&]() {
+      return std::span{regs}.subspan(FIRST_WRITABLE_REG, nSavedRegs);
+    };
+
+    auto load = [&]() {
+      for (int r : std::views::iota(0, static_cast<int>(nRegs))) {
+        regs[r] = state.readReg(r);
+      }
+      const size_t offset = state.getPC() - programStart;
+      idx                 = offset / CPU::cellsPerInst;
+      blockIdx            = idx;
+      skew                = offset % CPU::cellsPerInst;
+      idxEnd              = skew == 0 ? nInsts : nInsts - 1;
+      SP                  = state.getSP();
+    };
+
+    auto store = [&]() {
+      for (int r : std::views::iota(static_cast<int>(FIRST_WRITABLE_REG),
+                                    static_cast<int>(nRegs))) {
+        state.writeReg(r, regs[r]);
+      }
+      state.setSP(SP);
+      state.setPC(programStart + idx * CPU::cellsPerInst + skew);
+      retire(idx - blockIdx);
+      blockIdx = idx;
+      enterBlock();
+    };
+
+    // Unwritten frames are only created where the frame can be stored at
+    // once, so writing them out can't overflow or hit a watchpoint. The
+    // others are written word by word right away.
+    auto writeFrame = [&](const ShadowFrame &frame) {
+      const Addr frameBegin = frame.SP - frameSize;
+      state.writeWordToRAM(frameBegin,
+                           programStart + frame.retIdx * CPU::cellsPerInst);
+      if (state.writeWordsToRAM(frameBegin + CPU::cellsPerReg, frame.regs)) {
+        return;
+      }
+      for (size_t i = 0; i < nSavedRegs; i++) {
+        state.writeWordToRAM(frameBegin + (i + 1) * CPU::cellsPerReg,
+                             frame.regs[i]);
+      }
+    };
+
+    auto materialize = [&]() {
+      for (auto &frame : shadowStack) {
+        if (!frame.written) {
+          writeFrame(frame);
+          frame.written = true;
+        }
+      }
+      shadowStack.resize(liveFrames);
+      lazyBegin = std::numeric_limits<size_t>::max();
+      lazyEnd   = 0;
+    };
+
+    // Frames never wrap around the address space and start above the
+    // binary, so a wrapped access can't reach them.
+    auto touchesLazy = [&](Addr addr, size_t size) {
+      return addr + size > lazyBegin && addr < lazyEnd;
+    };
+
+    auto touchesLive = [&](Addr addr, size_t size) {
+      return liveFrames != 0 &&
+             addr + size > shadowStack.front().SP - frameSize &&
+             addr < shadowStack[liveFrames - 1].SP;
+    };
+
+    auto beforeLoad = [&](Addr addr, size_t size) {
+      if (touchesLazy(addr, size)) [[unlikely]] {
+        materialize();
+      }
+    };
+
+    // Writes out all the frames and drops the ones a store to
+    // [addr, addr + size) may overwrite.
+    auto beforeStore = [&](Addr addr, size_t size) {
+      if (touchesLazy(addr, size) || touchesLive(addr, size)) [[unlikely]] {
+        materialize();
+        while (liveFrames != 0 && addr < shadowStack[liveFrames - 1].SP) {
+          liveFrames--;
+        }
+        shadowStack.resize(liveFrames);
+      }
+    };
+
+    // Slow paths write the locals back, let the CPU state do the work and
+    // reload the locals from it. If the work throws, the CPU state is
+    // already the one to keep.
+    bool inSlowPath = false;
+    auto slowPath   = [&](auto &&f) {
+      materialize();
+      store();
+      shadowStack.clear();
+      liveFrames = 0;
+      inSlowPath = true;
+      f();
+      inSlowPath = false;
+      load();
+    };
+
+    auto enterIdx = [&](size_t newIdx) {
+      retire(idx - blockIdx);
+      idx      = newIdx;
+      blockIdx = idx;
+      skew     = 0;
+      idxEnd   = nInsts;
+    };
+
+    // Returns false when the target has to be validated by the CPU state.
+    auto jumpTo = [&](Reg target) -> bool {
+      if (target < programStart || target > programEnd ||
+          (target - programStart) % CPU::cellsPerInst != 0) [[unlikely]] {
+        return false;
+      }
+      enterIdx((target - programStart) / CPU::cellsPerInst);
+      return true;
+    };
+
+    // jumpTo() for JTR and CALL, cached per site
+    auto jumpFrom = [&](size_t site, Reg target) -> bool {
+      auto &entry = jumpCache[site];
+      if (entry.target == target) [[likely]] {
+        if constexpr (countsJumps) {
+          jumpCacheStats.hits++;
+        }
+        enterIdx(entry.idx);
+        return true;
+      }
+      if constexpr (countsJumps) {
+        jumpCacheStats.misses++;
+      }
+      if (!jumpTo(target)) [[unlikely]] {
+        return false;
+      }
+      entry = {target, idx};
+      return true;
+    };
+
+    auto checkDeadline = [&]() {
+      if (isDeadlineReached()) [[unlikely]] {
+        slowPath([this]() { handleDeadline(); });
+      }
+    };
+
+    if (state.getPC() < programStart) [[unlikely]] {
+      throw BadPC{};
+    }
+    load();
+    if (idx >= idxEnd) [[unlikely]] {
+      throw ProgramEnd{};
+    }
+
+    try {
+      do {
+        const auto [op, dst, srcL, srcR] = insts[idx++];
+        switch (op) {
+        case shisa::OpCode::ADD:
+          regs[dst] = regs[srcL] + regs[srcR];
+          break;
+        case shisa::OpCode::SUB:
+          regs[dst] = regs[srcL] - regs[srcR];
+          break;
+        case shisa::OpCode::MUL:
+          regs[dst] = regs[srcL] * regs[srcR];
+          break;
+        case shisa::OpCode::DIV:
+          if (regs[srcR] == 0) [[unlikely]] {
+            slowPath([&state]() { state.setPCToEnd(); });
+            break;
+          }
+          regs[dst] = regs[srcL] / regs[srcR];
+          break;
+        case shisa::OpCode::AND:
+          regs[dst] = regs[srcL] & regs[srcR];
+          break;
+        case shisa::OpCode::OR:
+          regs[dst] = regs[srcL] | regs[srcR];
+          break;
+        case shisa::OpCode::XOR:
+          regs[dst] = regs[srcL] ^ regs[srcR];
+          break;
+        case shisa::OpCode::CMP:
+          regs[dst] = regs[srcL] == regs[srcR] ? 0x0 : 0x1;
+          break;
+        case shisa::OpCode::NOT:
+          regs[dst] = ~regs[srcL];
+          break;
+        case shisa::OpCode::JTR:
+          if (regs[srcL] == 0) {
+            const Reg target = regs[srcR];
+            if (!jumpFrom(dst, target)) [[unlikely]] {
+              slowPath([&state, target]() { state.setPC(target); });
+            }
+            checkDeadline();
+          }
+          break;
+        case shisa::OpCode::LD:
+          beforeLoad(regs[srcL], CPU::cellsPerReg);
+          regs[dst] = state.readWordFromRAM(regs[srcL]);
+          break;
+        case shisa::OpCode::ST:
+          beforeStore(regs[srcL], CPU::cellsPerReg);
+          state.writeWordToRAM(regs[srcL], regs[srcR]);
+          state.checkWatchpoints();
+          break;
+        case shisa::OpCode::PUSH: {
+          beforeStore(SP, CPU::cellsPerReg);
+          if constexpr (CPU::RAMController::isProtected) {
+            if (state.tryStoreStackWord(SP, regs[srcL])) {
+              SP += CPU::cellsPerReg;
+              break;
+            }
+          }
+          state.writeWordToRAM(SP, regs[srcL]);
+          const Addr newSP = SP + CPU::cellsPerReg;
+          if (newSP > stackEnd) [[unlikely]] {
+            throw StackOverflow{};
+          }
+          SP = newSP;
+          state.checkWatchpoints();
+          break;
+        }
+        case shisa::OpCode::POP: {
+          const Addr newSP = SP - CPU::cellsPerReg;
+          if constexpr (CPU::RAMController::isProtected) {
+            beforeLoad(newSP, CPU::cellsPerReg);
+            if (state.tryLoadStackWord(newSP, regs[dst])) {
+              SP = newSP;
+              break;
+            }
+          }
+          if (SP < CPU::cellsPerReg || newSP < stackBegin) [[unlikely]] {
+            throw StackUnderflow{};
+          }
+          SP = newSP;
+          beforeLoad(SP, CPU::cellsPerReg);
+          regs[dst] = state.readWordFromRAM(SP);
+          break;
+        }
+        case shisa::OpCode::CALL: {
+          const Reg target = regs[dst];
+          if (SP + frameSize > stackEnd || skew != 0) [[unlikely]] {
+            slowPath([&state, target]() {
+              state.storePCOnStack();
+              state.storeRegsOnStack();
+              state.setPC(target);
+            });
+          } else {
+            // a frame returned from at the same slot is simply replaced
+            const bool reuse = shadowStack.size() > liveFrames &&
+                               shadowStack[liveFrames].SP == SP + frameSize;
+            if (!reuse) {
+              beforeStore(SP, frameSize);
+              if (shadowStack.size() > liveFrames) {
+                materialize();
+              }
+              shadowStack.emplace_back();
+            }
+
+            auto &frame  = shadowStack[liveFrames++];
+            frame.SP     = SP + frameSize;
+            frame.retIdx = idx;
+            std::copy_n(regs.begin() + FIRST_WRITABLE_REG, nSavedRegs,
+                        frame.regs.begin());
+            frame.written = !state.isBulkWritable(SP, frameSize);
+            if (frame.written) [[unlikely]] {
+              writeFrame(frame);
+            } else {
+              lazyBegin = std::min<size_t>(lazyBegin, SP);
+              lazyEnd   = std::max<size_t>(lazyEnd, SP + frameSize);
+            }
+            SP += frameSize;
+
+            if (!jumpFrom(srcL, target)) [[unlikely]] {
+              slowPath([&state, target]() { state.setPC(target); });
+            }
+          }
+          state.checkWatchpoints();
+          checkDeadline();
+          break;
+        }
+        case shisa::OpCode::RET: {
+          if (liveFrames != 0 && shadowStack[liveFrames - 1].SP == SP)
+              [[likely]] {
+            const auto &frame = shadowStack[--liveFrames];
+            std::copy(frame.regs.begin(), frame.regs.end(),
+                      regs.begin() + FIRST_WRITABLE_REG);
+            SP -= frameSize;
+            enterIdx(frame.retIdx);
+          } else if (SP < stackBegin + frameSize) [[unlikely]] {
+            slowPath([&state]() {
+              state.loadRegsFromStack();
+              state.loadPCFromStack();
+            });
+          } else {
+            beforeLoad(SP - frameSize, frameSize);
+            SP -= nSavedRegs * CPU::cellsPerReg;
+            if (!state.readWordsFromRAM(SP, savedRegs())) [[unlikely]] {
+              Addr addr = SP;
+              for (int r :
+                   std::views::iota(static_cast<int>(FIRST_WRITABLE_REG),
+                                    static_cast<int>(nRegs))) {
+                regs[r] = state.readWordFromRAM(addr);
+                addr += CPU::cellsPerReg;
+              }
+            }
+            SP -= CPU::cellsPerReg;
+            const Reg target = state.readWordFromRAM(SP);
+            if (!jumpTo(target)) [[unlikely]] {
+              slowPath([&state, target]() { state.setPC(target); });
+            }
+          }
+          checkDeadline();
+          break;
+        }
+        default:
+          throw shisa::InvalidInst{Inst::encode(op, dst, srcL, srcR)};
+          break;
+        }
+      } while (!singleStep && idx < idxEnd);
+    } catch (...) {
+      if (!inSlowPath) {
+        materialize();
+        store();
+      }
+      throw;
+    }
+
+    materialize();
+    store();
+    if (!singleStep && idx != nInsts) [[unlikely]] {
+      throw ProgramEnd{};
+    }
+  }
+
+public:
+  HoistedSim(BinaryView b) : HoistedSim{Program::load(b)} {}
+
+  explicit HoistedSim(std::shared_ptr<const Program> p)
+      : Sim{std::move(p)},
+        translation{getProgram().template getTranslation<Translation>(
+            translate)} {
+    // programStart always resolves to the first instruction, so it is a
+    // valid initial entry
+    jumpCache.assign(translation->nJumpSites,
+                     {getState().getProgramStart(), 0});
+  }
+
+  // A new sim in the state of this one, see SimBase::forkFrom(). The jump
+  // cache starts empty.
+  [[nodiscard]] auto fork() -> std::unique_ptr<HoistedSim> {
+    auto child = std::make_unique<HoistedSim>(Sim::shareProgram());
+    child->forkFrom(*this);
+    return child;
+  }
+
+  // only with SHISA_JUMP_CACHE_STATS
+  [[nodiscard]] auto getJumpCacheStats() const -> const JumpCacheStats &
+      requires(countsJumps) {
+    return jumpCacheStats;
+  }
+
+  void executeOne() override { run<true>(); }
+
+  void executeAll() override { run<false>(); }
+};
+
+template <class S>
+concept isHoistedSim =
+    std::is_same_v<S, HoistedSim<typename S::Reg, typename S::Addr,
+                                 typename S::Cell, shisa::NREGS,
+                                 typename S::RAM>>;
+
+} // namespace shisa::fsim
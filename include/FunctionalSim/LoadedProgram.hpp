@@ -0,0 +1,173 @@
+#pragma once
+
+#include "RAMController.hpp"
+
+#include <ShISA/Binary.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <climits>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <tuple>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+
+namespace shisa::fsim {
+
+// The read-only part of a binary loaded for running: its RAM image, the
+// predecoded instructions and the code engines translate from them. It is
+// built once and shared through a shared_ptr by every sim of the binary,
+// so a new sim only sets up its writable state.
+template <typename addr_t, typename cell_t>
+requires(std::unsigned_integral<addr_t> &&std::unsigned_integral<cell_t>)
+class LoadedProgramBase {
+public:
+  using Addr = addr_t;
+  using Cell = cell_t;
+
+  using DecodedInst = Inst::DecodedInst;
+
+  // the image is padded with zero cells to a whole number of these, so
+  // paged RAM maps all its pages
+  static constexpr size_t imageAlignment = 4096;
+
+private:
+  // the cells and instructions are in the vectors or, for a view, in the
+  // memory kept alive by owner
+  std::vector<Cell>            ownedImage{};
+  std::vector<DecodedInst>     ownedDecoded{};
+  std::shared_ptr<const void>  owner{};
+  std::span<const Cell>        image{};
+  Addr                         dataEnd   = 0;
+  Addr                         binaryEnd = 0;
+  std::span<const DecodedInst> decoded{};
+
+  mutable std::mutex mutex{};
+  mutable std::unordered_map<std::type_index, std::shared_ptr<const void>>
+      translations{};
+
+  struct Token {};
+
+public:
+  // The fields are in range. Engines index their tables with them, so
+  // predecoded instructions from a file must be checked before they run.
+  static auto isValidDecoded(const DecodedInst &inst) -> bool {
+    const auto isReg = [](int r) {
+      return r >= 0 && r < static_cast<int>(NREGS);
+    };
+    const auto op = static_cast<int>(inst.opCode);
+    return op >= static_cast<int>(OpCode::ADD) &&
+           op <= static_cast<int>(OpCode::RET) && isReg(inst.dst) &&
+           isReg(inst.srcL) && isReg(inst.srcR);
+  }
+
+  explicit LoadedProgramBase(BinaryView b, Token /*unused*/) {
+    using Controller = RAMControllerBase<Addr, Cell>;
+
+    constexpr size_t alignCells = imageAlignment / sizeof(Cell);
+    const size_t     cells      = Controller::binaryCells(b);
+    dataEnd   = static_cast<Addr>(b.nData() * Controller::cellsPerData);
+    binaryEnd = static_cast<Addr>(cells);
+    ownedImage.resize((cells + alignCells - 1) / alignCells * alignCells);
+    Controller::template toCells<Binary::Data>(b.getRawData(),
+                                               ownedImage.data());
+    Controller::template toCells<Inst::RawInst>(b.getInsts(),
+                                                ownedImage.data() + dataEnd);
+    image = ownedImage;
+
+    ownedDecoded.reserve(b.nInsts());
+    for (const Inst i : b.getInsts()) {
+      ownedDecoded.push_back(i.decode());
+    }
+    decoded = ownedDecoded;
+  }
+
+  explicit LoadedProgramBase(std::span<const Cell> img, Addr dataEndAddr,
+                             Addr binEnd, std::span<const DecodedInst> insts,
+                             std::shared_ptr<const void> imageOwner,
+                             Token /*unused*/)
+      : owner{std::move(imageOwner)}, image{img}, dataEnd{dataEndAddr},
+        binaryEnd{binEnd}, decoded{insts} {
+    constexpr size_t cellsPerInst = sizeof(Inst::RawInst) / sizeof(Cell);
+    constexpr size_t nCells       = RAMBase<Addr, Cell>::nCells;
+    SHISA_CHECK(dataEnd <= binaryEnd && binaryEnd <= image.size() &&
+                    image.size() <= nCells &&
+                    image.size() % (imageAlignment / sizeof(Cell)) == 0 &&
+                    (binaryEnd - dataEnd) % cellsPerInst == 0,
+                "bad program image layout");
+    const size_t nInsts = (binaryEnd - dataEnd) / cellsPerInst;
+    if (!decoded.empty()) {
+      SHISA_CHECK(decoded.size() == nInsts,
+                  "predecoded instructions don't match the image");
+      return;
+    }
+    // the instruction cells are big-endian, as splitBinary() writes them
+    ownedDecoded.reserve(nInsts);
+    for (size_t addr = dataEnd; addr < binaryEnd; addr += cellsPerInst) {
+      Inst::RawInst raw = 0;
+      for (size_t i = 0; i < cellsPerInst; i++) {
+        raw = static_cast<Inst::RawInst>(
+            (raw << (sizeof(Cell) * CHAR_BIT)) | image[addr + i]);
+      }
+      ownedDecoded.push_back(Inst{raw}.decode());
+    }
+    decoded = ownedDecoded;
+  }
+
+  LoadedProgramBase(const LoadedProgramBase &)                     = delete;
+  auto operator=(const LoadedProgramBase &) -> LoadedProgramBase & = delete;
+
+  [[nodiscard]] static auto load(BinaryView b)
+      -> std::shared_ptr<const LoadedProgramBase> {
+    return std::make_shared<const LoadedProgramBase>(b, Token{});
+  }
+
+  // A program over cells already laid out as getImage() returns them,
+  // e.g. in a mapped file, without copying them. owner keeps them alive.
+  // Without the predecoded instructions, they are decoded from the image.
+  // Given ones are not read here, so the caller checks them with
+  // isValidDecoded() unless it trusts them.
+  [[nodiscard]] static auto view(std::span<const Cell> image, Addr dataEnd,
+                                 Addr binEnd,
+                                 std::span<const DecodedInst> decoded,
+                                 std::shared_ptr<const void> owner)
+      -> std::shared_ptr<const LoadedProgramBase> {
+    return std::make_shared<const LoadedProgramBase>(
+        image, dataEnd, binEnd, decoded, std::move(owner), Token{});
+  }
+
+  // cells from address 0 on, the ones past getBinEnd() are zero
+  [[nodiscard]] auto getImage() const -> std::span<const Cell> {
+    return image;
+  }
+
+  [[nodiscard]] auto getDataEnd() const -> Addr { return dataEnd; }
+  [[nodiscard]] auto getBinEnd() const -> Addr { return binaryEnd; }
+
+  [[nodiscard]] auto getDecoded() const -> std::span<const DecodedInst> {
+    return decoded;
+  }
+
+  // The code of one engine, built by build(*this) on the first call for
+  // T and shared afterwards. Safe to call from several threads.
+  template <typename T, typename F>
+  auto getTranslation(F build) const -> std::shared_ptr<const T> {
+    const std::lock_guard lock{mutex};
+    auto &translation = translations[std::type_index{typeid(T)}];
+    if (!translation) {
+      translation = std::make_shared<const T>(build(*this));
+    }
+    return std::static_pointer_cast<const T>(translation);
+  }
+};
+
+} // namespace shisa::fsim
@@ -0,0 +1,492 @@
+#pragma once
+
+#include "RAMController.hpp"
+
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <concepts>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+
+// Guest RAM in host mappings of a memfd. The read-only binary and the stack
+// bounds are enforced by page protection, so guest stores and stack accesses
+// skip the explicit compares. A protection fault is turned into a C++
+// exception by a SIGSEGV handler and the access is then redone on the
+// checked path. Code that accesses a MappedRAM has to be compiled with
+// -fnon-call-exceptions, see SHISA_MAPPED_RAM in CMakeLists.txt.
+
+
+
+namespace shisa::fsim {
+
+class MemoryFault : public Exception {
+public:
+  MemoryFault() : Exception{"guest memory fault"} {}
+};
+
+
+
+// Host address ranges in which SIGSEGV is thrown as MemoryFault. Faults
+// anywhere else go to the previous handler. The list is only appended to,
+// so the handler can walk it without locks.
+class FaultRanges {
+public:
+  struct Range {
+    std::atomic<uintptr_t> begin{0};
+    std::atomic<uintptr_t> end{0};
+    std::atomic<bool>      used{true};
+    Range                 *next = nullptr;
+  };
+
+private:
+  static inline std::atomic<Range *> head{nullptr};
+  static inline std::once_flag       installed{};
+  static inline struct sigaction     previous {};
+
+  static auto contains(uintptr_t addr) -> bool {
+    for (Range *r = head.load(std::memory_order_acquire); r; r = r->next) {
+      if (r->begin.load(std::memory_order_acquire) <= addr &&
+          addr < r->end.load(std::memory_order_acquire)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void handler(int sig, siginfo_t *info, void *ctx) {
+    if (contains(reinterpret_cast<uintptr_t>(info->si_addr))) {
+      throw MemoryFault{};
+    }
+    if (previous.sa_flags & SA_SIGINFO) {
+      previous.sa_sigaction(sig, info, ctx);
+      return;
+    }
+    if (previous.sa_handler == SIG_DFL || previous.sa_handler == SIG_IGN) {
+      // the access faults again and terminates the process as usual
+      signal(sig, SIG_DFL);
+      return;
+    }
+    previous.sa_handler(sig);
+  }
+
+  static void install() {
+    struct sigaction action {};
+    action.sa_sigaction = handler;
+    // the handler is left by throwing, so SIGSEGV must not stay blocked
+    action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&action.sa_mask);
+    SHISA_CHECK(sigaction(SIGSEGV, &action, &previous) == 0,
+                "can't install the SIGSEGV handler");
+  }
+
+public:
+  static auto add(const void *begin, size_t size) -> Range * {
+    std::call_once(installed, install);
+
+    Range *range = nullptr;
+    for (Range *r = head.load(std::memory_order_acquire); r; r = r->next) {
+      bool used = false;
+      if (r->used.compare_exchange_strong(used, true)) {
+        range = r;
+        break;
+      }
+    }
+    if (!range) {
+      range       = new Range{};
+      range->next = head.load(std::memory_order_relaxed);
+      while (!head.compare_exchange_weak(range->next, range,
+                                         std::memory_order_release)) {
+      }
+    }
+    const auto first = reinterpret_cast<uintptr_t>(begin);
+    range->begin.store(first, std::memory_order_release);
+    range->end.store(first + size, std::memory_order_release);
+    return range;
+  }
+
+  static void remove(Range *range) {
+    range->end.store(0, std::memory_order_release);
+    range->begin.store(0, std::memory_order_release);
+    range->used.store(false, std::memory_order_release);
+  }
+};
+
+
+
+template <typename addr_t, typename cell_t>
+requires(std::unsigned_integral<addr_t>
+             &&std::unsigned_integral<cell_t>) class MappedRAM {
+public:
+  using Addr       = addr_t;
+  using Cell       = cell_t;
+  using MemStorage = std::array<Cell, std::numeric_limits<Addr>::max() + 1>;
+
+  static constexpr size_t nCells   = std::tuple_size_v<MemStorage>;
+  static constexpr Addr   lastAddr = std::numeric_limits<Addr>::max();
+
+  template <typename Word>
+  static constexpr bool hasWordPath = RAMBase<Addr, Cell>::template
+      hasWordPath<Word>;
+
+private:
+  static constexpr size_t nBytes = nCells * sizeof(Cell);
+
+  const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+  // Each view maps the file once plus its first page again right after the
+  // end, so a word at the last address wraps around to cell 0. Guest cell
+  // addr is at file offset addr + shift, the shift puts binaryEnd on a page
+  // boundary.
+  //  host  - read-write, for the checked paths and the bulk accesses
+  //  guest - the pages holding the binary are read-only
+  //  stack - only the stack pages are mapped, the view starts at binaryEnd
+  int   fd        = -1;
+  Cell *hostView  = nullptr;
+  Cell *guestView = nullptr;
+  Cell *stackView = nullptr;
+
+  size_t shift     = 0;
+  Addr   binaryEnd = 0;
+
+  FaultRanges::Range *guestRange = nullptr;
+  FaultRanges::Range *stackRange = nullptr;
+
+  [[nodiscard]] auto viewSize() const -> size_t { return nBytes + pageSize; }
+
+  [[nodiscard]] auto host() const -> Cell * { return hostView + shift; }
+  [[nodiscard]] auto guest() const -> Cell * { return guestView + shift; }
+
+  auto reserve() -> Cell * {
+    void *view = mmap(nullptr, viewSize(), PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    SHISA_CHECK(view != MAP_FAILED, "can't reserve the RAM mapping");
+    return static_cast<Cell *>(view);
+  }
+
+  void mapFile(void *at, size_t size, size_t offset, int prot) {
+    SHISA_CHECK(mmap(at, size, prot, MAP_SHARED | MAP_FIXED, fd,
+                     static_cast<off_t>(offset)) != MAP_FAILED,
+                "can't map the RAM");
+  }
+
+  void mapView(Cell *view, int prot) {
+    mapFile(view, nBytes, 0, prot);
+    mapFile(reinterpret_cast<char *>(view) + nBytes, pageSize, 0, prot);
+  }
+
+  void protect(void *at, size_t size, int prot) {
+    SHISA_CHECK(mprotect(at, size, prot) == 0, "can't protect the RAM");
+  }
+
+  // Maps the stack pages that are inside the address space. Stacks that
+  // would wrap around keep their last pages unmapped, those accesses fault
+  // and take the checked path.
+  void mapStack() {
+    SHISA_CHECK(mmap(stackView, viewSize(), PROT_NONE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                     -1, 0) != MAP_FAILED,
+                "can't reserve the stack mapping");
+    const size_t pageCells = pageSize / sizeof(Cell);
+    for (size_t page = 0; page < STACK_OFFSET / pageCells; page++) {
+      const size_t first = binaryEnd + page * pageCells;
+      if (first + pageCells > nCells) {
+        break;
+      }
+      mapFile(reinterpret_cast<char *>(stackView) + page * pageSize, pageSize,
+              ((first + shift) * sizeof(Cell)) % nBytes,
+              PROT_READ | PROT_WRITE);
+    }
+  }
+
+  void layout(Addr binEnd) {
+    const size_t bytesToPage =
+        (pageSize - (binEnd * sizeof(Cell)) % pageSize) % pageSize;
+    const size_t newShift = bytesToPage / sizeof(Cell);
+    if (newShift != shift) {
+      const std::vector<Cell> cells(host(), host() + nCells);
+      shift = newShift;
+      std::copy(cells.begin(), cells.end(), host());
+    }
+    binaryEnd = binEnd;
+
+    protect(guestView, viewSize(), PROT_READ | PROT_WRITE);
+    if (binaryEnd != 0) {
+      protect(guestView, (shift + binaryEnd) * sizeof(Cell), PROT_READ);
+      protect(reinterpret_cast<char *>(guestView) + nBytes, pageSize,
+              PROT_READ);
+    }
+    mapStack();
+  }
+
+  void release() {
+    if (guestRange) {
+      FaultRanges::remove(guestRange);
+    }
+    if (stackRange) {
+      FaultRanges::remove(stackRange);
+    }
+    for (Cell *view : {hostView, guestView, stackView}) {
+      if (view) {
+        munmap(view, viewSize());
+      }
+    }
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+
+  template <typename Word>
+  static constexpr size_t cellsPerWord = sizeof(Word) / sizeof(Cell);
+
+  template <typename Word>
+  static auto loadWord(const Cell *src) -> Word {
+    if constexpr (hasWordPath<Word>) {
+      uint16_t word = 0;
+      std::memcpy(&word, src, sizeof(word));
+      if constexpr (std::endian::native == std::endian::little) {
+        word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+      }
+      return word;
+    } else {
+      Word res = 0;
+      for (size_t i = 0; i < cellsPerWord<Word>; i++) {
+        res |= static_cast<Word>(src[i])
+               << (cellsPerWord<Word> - i - 1) * sizeof(Cell) * CHAR_BIT;
+      }
+      return res;
+    }
+  }
+
+  template <typename Word>
+  static void storeWord(Cell *dst, Word data) {
+    if constexpr (hasWordPath<Word>) {
+      auto word = static_cast<uint16_t>(data);
+      if constexpr (std::endian::native == std::endian::little) {
+        word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+      }
+      std::memcpy(dst, &word, sizeof(word));
+    } else {
+      for (size_t i = 0; i < cellsPerWord<Word>; i++) {
+        dst[i] = static_cast<Cell>(
+            data >> (cellsPerWord<Word> - i - 1) * sizeof(Cell) * CHAR_BIT);
+      }
+    }
+  }
+
+  // The accesses that may fault are volatile, otherwise the optimizer may
+  // drop or move them out of their try blocks. A word is one access, so it
+  // faults before any of its cells is written.
+  using UnalignedWord [[gnu::may_alias, gnu::aligned(1)]] = uint16_t;
+
+  template <typename Word>
+  static auto loadFaulting(const Cell *src) -> Word {
+    if constexpr (hasWordPath<Word>) {
+      uint16_t word = *reinterpret_cast<const volatile UnalignedWord *>(src);
+      if constexpr (std::endian::native == std::endian::little) {
+        word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+      }
+      return word;
+    } else {
+      const volatile Cell *cells = src;
+      Word                 res   = 0;
+      for (size_t i = 0; i < cellsPerWord<Word>; i++) {
+        res |= static_cast<Word>(cells[i])
+               << (cellsPerWord<Word> - i - 1) * sizeof(Cell) * CHAR_BIT;
+      }
+      return res;
+    }
+  }
+
+  // Without the word path the cells before the faulting one are written,
+  // the callers redo the whole word then.
+  template <typename Word>
+  static void storeFaulting(Cell *dst, Word data) {
+    if constexpr (hasWordPath<Word>) {
+      auto word = static_cast<uint16_t>(data);
+      if constexpr (std::endian::native == std::endian::little) {
+        word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+      }
+      *reinterpret_cast<volatile UnalignedWord *>(dst) = word;
+    } else {
+      volatile Cell *cells = dst;
+      for (size_t i = 0; i < cellsPerWord<Word>; i++) {
+        cells[i] = static_cast<Cell>(
+            data >> (cellsPerWord<Word> - i - 1) * sizeof(Cell) * CHAR_BIT);
+      }
+    }
+  }
+
+  [[nodiscard]] auto stackCell(Addr addr) const -> Cell * {
+    return stackView + static_cast<Addr>(addr - binaryEnd);
+  }
+
+public:
+  MappedRAM() {
+    SHISA_CHECK(pageSize % sizeof(Cell) == 0 && nBytes % pageSize == 0 &&
+                    (STACK_OFFSET * sizeof(Cell)) % pageSize == 0,
+                "host pages don't fit the guest address space and stack");
+
+    fd = memfd_create("shisa-ram", MFD_CLOEXEC);
+    SHISA_CHECK(fd != -1, "can't create the RAM file");
+    SHISA_CHECK(ftruncate(fd, static_cast<off_t>(nBytes)) == 0,
+                "can't size the RAM file");
+
+    hostView  = reserve();
+    guestView = reserve();
+    stackView = reserve();
+    mapView(hostView, PROT_READ | PROT_WRITE);
+    mapView(guestView, PROT_READ | PROT_WRITE);
+    layout(0);
+
+    guestRange = FaultRanges::add(guestView, viewSize());
+    stackRange = FaultRanges::add(stackView, viewSize());
+  }
+
+  MappedRAM(const MappedRAM &other) : MappedRAM{} { *this = other; }
+
+  auto operator=(const MappedRAM &other) -> MappedRAM & {
+    if (this != &other) {
+      std::copy(other.begin(), other.end(), begin());
+      layout(other.binaryEnd);
+    }
+    return *this;
+  }
+
+  MappedRAM(MappedRAM &&other) noexcept
+      : fd{std::exchange(other.fd, -1)},
+        hostView{std::exchange(other.hostView, nullptr)},
+        guestView{std::exchange(other.guestView, nullptr)},
+        stackView{std::exchange(other.stackView, nullptr)},
+        shift{other.shift}, binaryEnd{other.binaryEnd},
+        guestRange{std::exchange(other.guestRange, nullptr)},
+        stackRange{std::exchange(other.stackRange, nullptr)} {}
+
+  auto operator=(MappedRAM &&other) noexcept -> MappedRAM & {
+    if (this != &other) {
+      release();
+      fd         = std::exchange(other.fd, -1);
+      hostView   = std::exchange(other.hostView, nullptr);
+      guestView  = std::exchange(other.guestView, nullptr);
+      stackView  = std::exchange(other.stackView, nullptr);
+      shift      = other.shift;
+      binaryEnd  = other.binaryEnd;
+      guestRange = std::exchange(other.guestRange, nullptr);
+      stackRange = std::exchange(other.stackRange, nullptr);
+    }
+    return *this;
+  }
+
+  ~MappedRAM() { release(); }
+
+  void dump(std::ostream &os) const {
+    os << "RAM dump\n";
+    Addr addr = 0;
+    for (const auto cell : *this) {
+      os << "0x" << std::setw(2 * sizeof(Addr)) << std::right << std::hex
+         << std::setfill('0') << addr++ << " = 0x"
+         << std::setw(2 * sizeof(Cell)) << std::right << std::hex
+         << std::setfill('0') << static_cast<unsigned>(cell) << "\n";
+    }
+  }
+
+  auto begin() { return host(); }
+  auto end() { return host() + nCells; }
+
+  auto begin() const -> const Cell * { return host(); }
+  auto end() const -> const Cell * { return host() + nCells; }
+
+  // the cells past the end mirror the first ones
+  auto data() -> Cell * { return host(); }
+  auto data() const -> const Cell * { return host(); }
+
+  auto read(Addr addr) const -> Cell { return host()[addr]; }
+  void write(Addr addr, Cell data) { host()[addr] = data; }
+
+  template <typename Word>
+  requires hasWordPath<Word>
+  auto readWord(Addr addr) const -> Word {
+    return loadWord<Word>(host() + addr);
+  }
+
+  template <typename Word>
+  requires hasWordPath<Word>
+  void writeWord(Addr addr, Word data) {
+    storeWord(host() + addr, data);
+  }
+
+  // Makes [0, binEnd) read-only for the guest accesses below and puts the
+  // stack view at binEnd.
+  void placeBinary(Addr binEnd) { layout(binEnd); }
+
+  // Stores of the guest, dropped for the read-only binary. The pages are
+  // host pages, so a store next to the binary may fault as well and is
+  // redone with a compare. The accessors that may fault are not inlined to
+  // keep their exception regions out of the engines' loops.
+  [[gnu::noinline]] void writeGuest(Addr addr, Cell data) {
+    try {
+      *static_cast<volatile Cell *>(guest() + addr) = data;
+    } catch (const MemoryFault &) {
+      if (addr >= binaryEnd) {
+        write(addr, data);
+      }
+    }
+  }
+
+  template <typename Word>
+  [[gnu::noinline]] void writeWordGuest(Addr addr, Word data) {
+    try {
+      storeFaulting(guest() + addr, data);
+    } catch (const MemoryFault &) {
+      for (size_t i = 0; i < cellsPerWord<Word>; i++) {
+        const Addr   cellAddr = addr + static_cast<Addr>(i);
+        const size_t cellIdx  = cellsPerWord<Word> - i - 1;
+        if (cellAddr >= binaryEnd) {
+          write(cellAddr,
+                static_cast<Cell>(data >> cellIdx * sizeof(Cell) * CHAR_BIT));
+        }
+      }
+    }
+  }
+
+  // Word accesses that succeed iff the word is in
+  // [binaryEnd, binaryEnd + STACK_OFFSET). Nothing is touched otherwise.
+  template <typename Word>
+  [[gnu::noinline]] auto storeStackWord(Addr addr, Word data) -> bool {
+    try {
+      storeFaulting(stackCell(addr), data);
+    } catch (const MemoryFault &) {
+      return false;
+    }
+    return true;
+  }
+
+  template <typename Word>
+  [[gnu::noinline]] auto loadStackWord(Addr addr, Word &data) const -> bool {
+    try {
+      data = loadFaulting<Word>(stackCell(addr));
+    } catch (const MemoryFault &) {
+      return false;
+    }
+    return true;
+  }
+};
+
+} // namespace shisa::fsim
@@ -0,0 +1,469 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <climits>
+#include <concepts>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+
+// Guest RAM split in 4 KiB pages that are allocated on the first write.
+// Untouched pages are read from a single zero page shared by all the
+// instances, so the resident size follows the memory the guest touches
+// rather than the size of the address space. It also makes 32-bit address
+// configurations possible, their flat RAMBase would be a 4 GiB array.
+// The page table has two levels, so a 32-bit RAM starts with a 16 KiB
+// table rather than one entry per page. Pages are shared copy-on-write
+// with forks, see fork().
+
+
+
+namespace shisa::fsim {
+
+template <typename addr_t, typename cell_t>
+requires(std::unsigned_integral<addr_t> &&std::unsigned_integral<cell_t> &&
+         sizeof(addr_t) < sizeof(size_t)) class PagedRAM {
+public:
+  using Addr = addr_t;
+  using Cell = cell_t;
+
+  static constexpr size_t nCells =
+      static_cast<size_t>(std::numeric_limits<Addr>::max()) + 1;
+  static constexpr Addr lastAddr = std::numeric_limits<Addr>::max();
+
+  static constexpr size_t pageCells =
+      std::min<size_t>(4096 / sizeof(Cell), nCells);
+  static constexpr size_t pageBits = std::countr_zero(pageCells);
+  static constexpr size_t pageMask = pageCells - 1;
+  static constexpr size_t nPages   = nCells / pageCells;
+
+  static_assert(std::has_single_bit(pageCells),
+                "page must hold a power of two of cells");
+
+  // pages per second level table, all of them for 16-bit addresses
+  static constexpr size_t leafPages = std::min<size_t>(512, nPages);
+  static constexpr size_t leafBits  = std::countr_zero(leafPages);
+  static constexpr size_t leafMask  = leafPages - 1;
+  static constexpr size_t nLeaves   = nPages / leafPages;
+
+  // same as RAMBase, a word never crosses a page but at the last cell
+  template <typename Word>
+  static constexpr bool hasWordPath =
+      std::unsigned_integral<Word> && sizeof(Cell) == 1 && sizeof(Word) == 2 &&
+      (std::endian::native == std::endian::little ||
+       std::endian::native == std::endian::big);
+
+private:
+  // Never written, every page table entry of an untouched page points here.
+  static inline const std::array<Cell, pageCells> zeroPage{};
+
+  // Pages are the zero page, pages of a shared image or allocated frames.
+  // A frame may be shared with forks. Only the pages marked writable are
+  // held by this RAM alone, the others are copied on their first write.
+  struct Leaf {
+    std::array<const Cell *, leafPages>             pages;
+    std::array<std::shared_ptr<Cell[]>, leafPages> frames{};
+    std::bitset<leafPages>                          writable{};
+  };
+
+  // Never written, every untouched leaf is this one. A leaf is allocated
+  // on the first write to one of its pages and held by this RAM alone.
+  static inline const Leaf zeroLeaf = []() {
+    Leaf leaf{};
+    leaf.pages.fill(zeroPage.data());
+    return leaf;
+  }();
+
+  std::array<const Leaf *, nLeaves> leaves = []() {
+    std::array<const Leaf *, nLeaves> table{};
+    table.fill(&zeroLeaf);
+    return table;
+  }();
+
+  std::shared_ptr<const void> imageOwner{};
+
+  [[nodiscard]] static auto pageOf(Addr addr) -> size_t {
+    return addr >> pageBits;
+  }
+
+  [[nodiscard]] static auto offsetOf(Addr addr) -> size_t {
+    return addr & pageMask;
+  }
+
+  [[nodiscard]] static auto isZeroPage(const Cell *page) -> bool {
+    return page == zeroPage.data();
+  }
+
+  [[nodiscard]] auto leafOf(size_t page) const -> const Leaf & {
+    return *leaves[page >> leafBits];
+  }
+
+  [[nodiscard]] auto pageAt(size_t page) const -> const Cell * {
+    return leafOf(page).pages[page & leafMask];
+  }
+
+  [[nodiscard]] auto frameAt(size_t page) const
+      -> const std::shared_ptr<Cell[]> & {
+    return leafOf(page).frames[page & leafMask];
+  }
+
+  // the leaf of page, allocated if it is the zero leaf
+  auto ownLeaf(size_t page) -> Leaf & {
+    const Leaf *&leaf = leaves[page >> leafBits];
+    if (leaf == &zeroLeaf) {
+      leaf = new Leaf{zeroLeaf};
+    }
+    // allocated non-const above
+    return const_cast<Leaf &>(*leaf);
+  }
+
+  void makeWritable(size_t page) {
+    Leaf        &leaf  = ownLeaf(page);
+    const size_t i     = page & leafMask;
+    auto        &frame = leaf.frames[i];
+    if (!frame || frame.use_count() > 1) {
+      std::shared_ptr<Cell[]> copy{new Cell[pageCells]};
+      std::copy_n(leaf.pages[i], pageCells, copy.get());
+      leaf.pages[i] = copy.get();
+      frame         = std::move(copy);
+    } else {
+      // The last holder of a shared frame takes it over. The other holders,
+      // forks on other threads too, dropped it with a release decrement of
+      // the count, which use_count() loads relaxed. The fence orders their
+      // reads of the frame before the writes to it here.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    leaf.writable[i] = true;
+  }
+
+  auto writablePage(size_t page) -> Cell * {
+    if (!leafOf(page).writable[page & leafMask]) [[unlikely]] {
+      makeWritable(page);
+    }
+    return const_cast<Cell *>(pageAt(page));
+  }
+
+  void releasePage(size_t page) {
+    if (leaves[page >> leafBits] == &zeroLeaf) {
+      return;
+    }
+    Leaf        &leaf = ownLeaf(page);
+    const size_t i    = page & leafMask;
+    leaf.frames[i].reset();
+    leaf.writable[i] = false;
+    leaf.pages[i]    = zeroPage.data();
+  }
+
+  void release() {
+    for (const Leaf *&leaf : leaves) {
+      if (leaf != &zeroLeaf) {
+        delete leaf;
+        leaf = &zeroLeaf;
+      }
+    }
+    imageOwner.reset();
+  }
+
+  // f(page) for the pages of the allocated leaves
+  template <typename F>
+  void forEachLeafPage(F f) const {
+    for (size_t l = 0; l < nLeaves; l++) {
+      if (leaves[l] != &zeroLeaf) {
+        for (size_t i = 0; i < leafPages; i++) {
+          f(l << leafBits | i);
+        }
+      }
+    }
+  }
+
+public:
+  // Merges the identical frames of the RAMs passed to deduplicate() into
+  // shared copy-on-write frames and frees the frames of zero cells. The
+  // frames seen so far are kept until the deduplicator is destroyed. Not
+  // thread-safe, one pass runs on one thread.
+  class Deduplicator {
+  public:
+    struct Stats {
+      size_t scannedPages = 0;
+      size_t mergedPages  = 0;
+      size_t zeroPages    = 0;
+      // frames freed, the ones still held by some RAM not counted
+      size_t savedBytes = 0;
+    };
+
+  private:
+    std::unordered_multimap<uint64_t, std::shared_ptr<Cell[]>> seen{};
+    Stats                                                      stats{};
+
+    static auto hash(const Cell *page) -> uint64_t {
+      // FNV-1a over 64-bit words
+      uint64_t h = 0xcbf29ce484222325;
+      for (size_t i = 0; i < pageCells * sizeof(Cell); i += sizeof(h)) {
+        uint64_t word = 0;
+        std::memcpy(&word, reinterpret_cast<const char *>(page) + i,
+                    sizeof(word));
+        h = (h ^ word) * 0x100000001b3;
+      }
+      return h;
+    }
+
+    static auto isZero(const Cell *page) -> bool {
+      return std::memcmp(page, zeroPage.data(), sizeof(zeroPage)) == 0;
+    }
+
+    friend class PagedRAM;
+
+    void deduplicate(PagedRAM &ram, size_t page) {
+      Leaf        &leaf  = ram.ownLeaf(page);
+      const size_t i     = page & leafMask;
+      auto        &frame = leaf.frames[i];
+      stats.scannedPages++;
+
+      const auto countFreed = [&]() {
+        if (frame.use_count() == 1) {
+          stats.savedBytes += sizeof(zeroPage);
+        }
+      };
+
+      if (isZero(frame.get())) {
+        stats.zeroPages++;
+        countFreed();
+        ram.releasePage(page);
+        return;
+      }
+
+      const uint64_t h = hash(frame.get());
+      for (auto [it, end] = seen.equal_range(h); it != end; ++it) {
+        const auto &other = it->second;
+        if (other == frame) {
+          return;
+        }
+        if (std::memcmp(other.get(), frame.get(), sizeof(zeroPage)) == 0) {
+          stats.mergedPages++;
+          countFreed();
+          frame            = other;
+          leaf.pages[i]    = other.get();
+          leaf.writable[i] = false;
+          return;
+        }
+      }
+      // other RAMs may map it from now on
+      seen.emplace(h, frame);
+      leaf.writable[i] = false;
+    }
+
+  public:
+    [[nodiscard]] auto getStats() const -> const Stats & { return stats; }
+  };
+
+  // Read-only iteration over all the cells, untouched pages read as zero.
+  class ConstIterator {
+  public:
+    using value_type        = Cell;
+    using difference_type   = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+
+  private:
+    const PagedRAM *ram  = nullptr;
+    size_t          cell = 0;
+
+  public:
+    ConstIterator() = default;
+    ConstIterator(const PagedRAM *r, size_t c) : ram{r}, cell{c} {}
+
+    auto operator*() const -> Cell {
+      return ram->read(static_cast<Addr>(cell));
+    }
+
+    auto operator++() -> ConstIterator & {
+      cell++;
+      return *this;
+    }
+
+    auto operator++(int) -> ConstIterator {
+      ConstIterator prev = *this;
+      cell++;
+      return prev;
+    }
+
+    auto operator==(const ConstIterator &other) const -> bool {
+      return cell == other.cell;
+    }
+  };
+
+  PagedRAM() = default;
+
+  PagedRAM(const PagedRAM &other) { *this = other; }
+
+  auto operator=(const PagedRAM &other) -> PagedRAM & {
+    if (this != &other) {
+      release();
+      imageOwner = other.imageOwner;
+      // the frames of other are copied from its pages
+      other.forEachLeafPage([&](size_t page) {
+        ownLeaf(page).pages[page & leafMask] = other.pageAt(page);
+        if (other.frameAt(page)) {
+          makeWritable(page);
+        }
+      });
+    }
+    return *this;
+  }
+
+  PagedRAM(PagedRAM &&other) noexcept { *this = std::move(other); }
+
+  auto operator=(PagedRAM &&other) noexcept -> PagedRAM & {
+    if (this != &other) {
+      release();
+      std::swap(leaves, other.leaves);
+      std::swap(imageOwner, other.imageOwner);
+    }
+    return *this;
+  }
+
+  ~PagedRAM() { release(); }
+
+  // Only the pages that are not the zero page are dumped.
+  void dump(std::ostream &os) const {
+    os << "RAM dump\n";
+    forEachLeafPage([&](size_t page) {
+      const Cell *cells = pageAt(page);
+      if (isZeroPage(cells)) {
+        return;
+      }
+      for (size_t i = 0; i < pageCells; i++) {
+        os << "0x" << std::setw(2 * sizeof(Addr)) << std::right << std::hex
+           << std::setfill('0') << (page << pageBits | i) << " = 0x"
+           << std::setw(2 * sizeof(Cell)) << std::right << std::hex
+           << std::setfill('0') << static_cast<unsigned>(cells[i]) << "\n";
+      }
+    });
+  }
+
+  auto begin() const { return ConstIterator{this, 0}; }
+  auto end() const { return ConstIterator{this, nCells}; }
+
+  // frames held by this RAM, shared ones included
+  [[nodiscard]] auto allocatedPages() const -> size_t {
+    size_t n = 0;
+    forEachLeafPage([&](size_t page) { n += frameAt(page) != nullptr; });
+    return n;
+  }
+
+  // frames held by some fork too
+  [[nodiscard]] auto sharedPages() const -> size_t {
+    size_t n = 0;
+    forEachLeafPage([&](size_t page) { n += frameAt(page).use_count() > 1; });
+    return n;
+  }
+
+  // RAM with the same cells sharing all the pages of this one, each of
+  // them copies a shared page on the first write to it. Takes the time of
+  // a copy of the allocated leaves of the page table, not of the cells.
+  auto fork() -> PagedRAM {
+    PagedRAM child{};
+    child.imageOwner = imageOwner;
+    for (size_t l = 0; l < nLeaves; l++) {
+      if (leaves[l] != &zeroLeaf) {
+        Leaf &leaf = ownLeaf(l << leafBits);
+        leaf.writable.reset();
+        child.leaves[l] = new Leaf{leaf};
+      }
+    }
+    return child;
+  }
+
+  // Maps the pages fully covered by image instead of copying them, owner
+  // keeps image alive. The cells of a last partial page are written.
+  void shareImage(std::span<const Cell> image,
+                  std::shared_ptr<const void> owner) {
+    const size_t nShared = image.size() / pageCells;
+    for (size_t page = 0; page < nShared; page++) {
+      releasePage(page);
+      ownLeaf(page).pages[page & leafMask] = image.data() + page * pageCells;
+    }
+    for (size_t cell = nShared * pageCells; cell < image.size(); cell++) {
+      write(static_cast<Addr>(cell), image[cell]);
+    }
+    imageOwner = std::move(owner);
+  }
+
+  // f(addr, cells) for the parts of [first, first + size) in each page,
+  // the range must not wrap around
+  template <typename F>
+  void forEachSpan(Addr first, size_t size, F f) const {
+    for (size_t addr = first; addr < first + size;) {
+      const size_t n = std::min(pageCells - offsetOf(static_cast<Addr>(addr)),
+                                first + size - addr);
+      f(addr, std::span<const Cell>{pageAt(pageOf(static_cast<Addr>(addr))) +
+                                        offsetOf(static_cast<Addr>(addr)),
+                                    n});
+      addr += n;
+    }
+  }
+
+  // Must not race with accesses to this RAM, other RAMs may run.
+  void deduplicate(Deduplicator &dedup) {
+    forEachLeafPage([&](size_t page) {
+      if (frameAt(page)) {
+        dedup.deduplicate(*this, page);
+      }
+    });
+  }
+
+  auto read(Addr addr) const -> Cell {
+    return pageAt(pageOf(addr))[offsetOf(addr)];
+  }
+
+  void write(Addr addr, Cell data) {
+    writablePage(pageOf(addr))[offsetOf(addr)] = data;
+  }
+
+  // big-endian word at addr, wrapping around the address space
+  template <typename Word>
+  requires hasWordPath<Word>
+  auto readWord(Addr addr) const -> Word {
+    if (offsetOf(addr) == pageMask) [[unlikely]] {
+      return static_cast<Word>(read(addr) << CHAR_BIT |
+                               read(static_cast<Addr>(addr + 1)));
+    }
+    uint16_t word = 0;
+    std::memcpy(&word, pageAt(pageOf(addr)) + offsetOf(addr), sizeof(word));
+    if constexpr (std::endian::native == std::endian::little) {
+      word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+    }
+    return word;
+  }
+
+  template <typename Word>
+  requires hasWordPath<Word>
+  void writeWord(Addr addr, Word data) {
+    if (offsetOf(addr) == pageMask) [[unlikely]] {
+      write(addr, static_cast<Cell>(data >> CHAR_BIT));
+      write(static_cast<Addr>(addr + 1), static_cast<Cell>(data));
+      return;
+    }
+    auto word = static_cast<uint16_t>(data);
+    if constexpr (std::endian::native == std::endian::little) {
+      word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+    }
+    std::memcpy(writablePage(pageOf(addr)) + offsetOf(addr), &word,
+                sizeof(word));
+  }
+};
+
+} // namespace shisa::fsim
@@ -5,32 +5,43 @@
 #include <ShISA/Inst.hpp>
 #include <exceptions.hpp>
 
-#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
 
 
 
 namespace shisa::fsim {
 
 template <typename reg_t = uint16_t, typename addr_t = uint16_t,
-          typename cell_t = uint8_t, size_t nRegs = NREGS>
-class PredecodedSim final : public SimBase<reg_t, addr_t, cell_t, nRegs> {
-  std::vector<shisa::Inst::DecodedInst> predecodedInsts{};
+          typename cell_t = uint8_t, size_t nRegs = NREGS,
+          class ram_t = RAMBase<addr_t, cell_t>>
+class PredecodedSim final
+    : public SimBase<reg_t, addr_t, cell_t, nRegs, ram_t> {
+  // owned by the program shared with the other sims
+  std::span<const shisa::Inst::DecodedInst> predecodedInsts{};
 
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
 
-  using Sim = SimBase<Reg, Addr, Cell, nRegs>;
+  using Sim     = SimBase<Reg, Addr, Cell, nRegs, ram_t>;
+  using Program = typename Sim::Program;
 
   USING_SIM_BASE(Sim);
 
-  PredecodedSim(const Binary &b) : Sim{b} {
-    const auto &insts = b.getISAModule();
-    std::for_each(insts.begin(), insts.end(), [this](const shisa::Inst i) {
-      predecodedInsts.push_back(i.decode());
-    });
+  PredecodedSim(BinaryView b) : PredecodedSim{Program::load(b)} {}
+
+  explicit PredecodedSim(std::shared_ptr<const Program> p)
+      : Sim{std::move(p)}, predecodedInsts{getProgram().getDecoded()} {}
+
+  // a new sim in the state of this one, see SimBase::forkFrom()
+  [[nodiscard]] auto fork() -> std::unique_ptr<PredecodedSim> {
+    auto child = std::make_unique<PredecodedSim>(Sim::shareProgram());
+    child->forkFrom(*this);
+    return child;
   }
 
   void executeOne() override {
@@ -99,6 +110,7 @@ public:
 template <class S>
 concept isPredecodedSim =
     std::is_same_v<S, PredecodedSim<typename S::Reg, typename S::Addr,
-                                    typename S::Cell, shisa::NREGS>>;
+                                    typename S::Cell, shisa::NREGS,
+                                    typename S::RAM>>;
 
 } // namespace shisa::fsim
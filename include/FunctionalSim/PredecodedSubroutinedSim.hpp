@@ -7,23 +7,29 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <span>
+#include <utility>
 
 
 
 namespace shisa::fsim {
 
 template <typename reg_t = uint16_t, typename addr_t = uint16_t,
-          typename cell_t = uint8_t, size_t nRegs = NREGS>
+          typename cell_t = uint8_t, size_t nRegs = NREGS,
+          class ram_t = RAMBase<addr_t, cell_t>>
 class PredecodedSubroutinedSim final
-    : public SimBase<reg_t, addr_t, cell_t, nRegs> {
-  std::vector<shisa::Inst::DecodedInst> predecodedInsts{};
+    : public SimBase<reg_t, addr_t, cell_t, nRegs, ram_t> {
+  // owned by the program shared with the other sims
+  std::span<const shisa::Inst::DecodedInst> predecodedInsts{};
 
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
 
-  using Sim = SimBase<Reg, Addr, Cell, nRegs>;
+  using Sim     = SimBase<Reg, Addr, Cell, nRegs, ram_t>;
+  using Program = typename Sim::Program;
 
   USING_SIM_BASE(Sim);
 
@@ -54,11 +60,18 @@ private:
       };
 
 public:
-  PredecodedSubroutinedSim(const Binary &b) : Sim{b} {
-    const auto &insts = b.getISAModule();
-    std::for_each(insts.begin(), insts.end(), [this](const shisa::Inst i) {
-      predecodedInsts.push_back(i.decode());
-    });
+  PredecodedSubroutinedSim(BinaryView b)
+      : PredecodedSubroutinedSim{Program::load(b)} {}
+
+  explicit PredecodedSubroutinedSim(std::shared_ptr<const Program> p)
+      : Sim{std::move(p)}, predecodedInsts{getProgram().getDecoded()} {}
+
+  // a new sim in the state of this one, see SimBase::forkFrom()
+  [[nodiscard]] auto fork() -> std::unique_ptr<PredecodedSubroutinedSim> {
+    auto child =
+        std::make_unique<PredecodedSubroutinedSim>(Sim::shareProgram());
+    child->forkFrom(*this);
+    return child;
   }
 
   void executeOne() override {
@@ -76,6 +89,7 @@ template <class S>
 concept isPredecodedSubroutinedSim =
     std::is_same_v<S,
                    PredecodedSubroutinedSim<typename S::Reg, typename S::Addr,
-                                            typename S::Cell, shisa::NREGS>>;
+                                            typename S::Cell, shisa::NREGS,
+                                            typename S::RAM>>;
 
 } // namespace shisa::fsim
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "LoadedProgram.hpp"
+#include "StateCompare.hpp"
+
+#include <ShISA/Binary.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+
+// The .shbin file of a loaded program, laid out so that mapping it gives the
+// program without copying or parsing anything:
+//
+//   header      ProgramFileHeader, padded to sectionAlignment bytes
+//   image       the cells of LoadedProgramBase::getImage(): the data section
+//               is cells [0, dataEnd), the code section [dataEnd, binEnd)
+//   predecoded  optional, the Inst::DecodedInst of the code section
+//
+// Integers and cells are in the byte order of the host that wrote the file,
+// which the header records, so a file is read on a host of the same byte
+// order only. The predecoded section is used when its layout matches the
+// one of the host and decoded from the image otherwise. The checksum
+// covers the header and the sections. Checking it reads the whole file, so
+// it is optional, and so is the range check of the predecoded fields that
+// comes with it. A file that is not checked is trusted: engines index
+// their tables with the predecoded fields.
+
+
+
+namespace shisa::fsim {
+
+struct ProgramFileHeader {
+  static constexpr std::array<char, 8> shbinMagic = {'S', 'h', 'I', 'S',
+                                                     'A', 'b', 'i', 'n'};
+  static constexpr uint32_t            shbinVersion = 1;
+  static constexpr uint32_t            hostOrder    = 0x01020304;
+
+  std::array<char, 8> magic     = shbinMagic;
+  uint32_t            version   = shbinVersion;
+  uint32_t            byteOrder = hostOrder;
+
+  uint8_t  addrBytes        = 0;
+  uint8_t  cellBytes        = 0;
+  uint8_t  dataBytes        = sizeof(Binary::Data);
+  uint8_t  instBytes        = sizeof(Inst::RawInst);
+  uint32_t decodedInstBytes = sizeof(Inst::DecodedInst);
+
+  uint64_t dataEnd       = 0;
+  uint64_t binEnd        = 0;
+  uint64_t imageOffset   = 0;
+  uint64_t imageCells    = 0;
+  uint64_t decodedOffset = 0;
+  uint64_t nDecoded      = 0; // 0 without the predecoded section
+  uint64_t checksum      = 0; // of the file with this field zero
+};
+
+static_assert(std::is_trivially_copyable_v<ProgramFileHeader> &&
+              std::is_trivially_copyable_v<Inst::DecodedInst>);
+
+enum class Checksum { skip, verify };
+
+// the sections start at multiples of this many bytes
+constexpr size_t sectionAlignment = 4096;
+
+namespace program_file_detail {
+
+inline auto alignUp(uint64_t offset) -> uint64_t {
+  return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+inline auto checksumOf(ProgramFileHeader header,
+                       std::span<const std::byte> image,
+                       std::span<const std::byte> decoded) -> uint64_t {
+  header.checksum = 0;
+  StateHasher hasher{};
+  hasher.update(&header, sizeof(header));
+  hasher.update(image);
+  hasher.update(decoded);
+  return hasher.digest();
+}
+
+} // namespace program_file_detail
+
+// A whole file mapped read-only. The pages are read in on first access.
+class MappedFile {
+  void  *addr = nullptr;
+  size_t size = 0;
+
+public:
+  explicit MappedFile(const std::string &path) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    SHISA_CHECK(fd != -1, "can't open " + path);
+    struct stat st {};
+    const bool  sized = fstat(fd, &st) == 0;
+    size              = sized ? static_cast<size_t>(st.st_size) : 0;
+    if (size != 0) {
+      addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    SHISA_CHECK(sized && size != 0 && addr != MAP_FAILED,
+                "can't map " + path);
+  }
+
+  MappedFile(const MappedFile &)                     = delete;
+  auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+  ~MappedFile() {
+    if (addr != nullptr && addr != MAP_FAILED) {
+      munmap(addr, size);
+    }
+  }
+
+  [[nodiscard]] auto bytes() const -> std::span<const std::byte> {
+    return {static_cast<const std::byte *>(addr), size};
+  }
+};
+
+template <typename Addr, typename Cell>
+void saveProgram(const std::string &path,
+                 const LoadedProgramBase<Addr, Cell> &program,
+                 bool predecoded = true) {
+  using program_file_detail::alignUp;
+
+  const auto image   = std::as_bytes(program.getImage());
+  const auto decoded = predecoded ? std::as_bytes(program.getDecoded())
+                                  : std::span<const std::byte>{};
+
+  ProgramFileHeader header{};
+  header.addrBytes     = sizeof(Addr);
+  header.cellBytes     = sizeof(Cell);
+  header.dataEnd       = program.getDataEnd();
+  header.binEnd        = program.getBinEnd();
+  header.imageOffset   = alignUp(sizeof(header));
+  header.imageCells    = program.getImage().size();
+  header.decodedOffset = alignUp(header.imageOffset + image.size());
+  header.nDecoded      = predecoded ? program.getDecoded().size() : 0;
+  header.checksum = program_file_detail::checksumOf(header, image, decoded);
+
+  std::ofstream os{path, std::ios::binary | std::ios::trunc};
+  SHISA_CHECK(os.good(), "can't create " + path);
+  const auto put = [&os](uint64_t offset, std::span<const std::byte> bytes) {
+    // zeros up to the section
+    const std::array<char, sectionAlignment> zeros{};
+    const auto pad = static_cast<size_t>(offset) -
+                     static_cast<size_t>(os.tellp());
+    os.write(zeros.data(), static_cast<std::streamsize>(pad));
+    os.write(reinterpret_cast<const char *>(bytes.data()),
+             static_cast<std::streamsize>(bytes.size()));
+  };
+  put(0, std::as_bytes(std::span{&header, 1}));
+  put(header.imageOffset, image);
+  if (!decoded.empty()) {
+    put(header.decodedOffset, decoded);
+  }
+  os.close();
+  SHISA_CHECK(!os.fail(), "can't write " + path);
+}
+
+template <typename Addr, typename Cell>
+void saveProgram(const std::string &path, BinaryView b,
+                 bool predecoded = true) {
+  saveProgram(path, *LoadedProgramBase<Addr, Cell>::load(b), predecoded);
+}
+
+// The program of a .shbin file as a view of the mapped file: the image is
+// neither copied nor read here, its pages are read in as the sims touch
+// them, and RAM that shares the image maps them directly.
+template <typename Addr, typename Cell>
+[[nodiscard]] auto mapProgram(const std::string &path,
+                              Checksum check = Checksum::skip)
+    -> std::shared_ptr<const LoadedProgramBase<Addr, Cell>> {
+  using Program     = LoadedProgramBase<Addr, Cell>;
+  using DecodedInst = typename Program::DecodedInst;
+
+  auto       file  = std::make_shared<const MappedFile>(path);
+  const auto bytes = file->bytes();
+
+  ProgramFileHeader header{};
+  SHISA_CHECK(bytes.size() >= sizeof(header), path + ": not a .shbin file");
+  std::memcpy(&header, bytes.data(), sizeof(header));
+  SHISA_CHECK(header.magic == ProgramFileHeader::shbinMagic,
+              path + ": not a .shbin file");
+  SHISA_CHECK(header.version == ProgramFileHeader::shbinVersion,
+              path + ": unsupported .shbin version");
+  SHISA_CHECK(header.byteOrder == ProgramFileHeader::hostOrder &&
+                  header.addrBytes == sizeof(Addr) &&
+                  header.cellBytes == sizeof(Cell) &&
+                  header.dataBytes == sizeof(Binary::Data) &&
+                  header.instBytes == sizeof(Inst::RawInst),
+              path + ": written for another host or sim");
+
+  // the sizes are checked against the file by division, the products of
+  // a corrupt header could overflow
+  const bool hasDecoded = header.nDecoded != 0;
+  SHISA_CHECK(header.imageOffset % sectionAlignment == 0 &&
+                  header.imageOffset <= bytes.size() &&
+                  header.imageCells <=
+                      (bytes.size() - header.imageOffset) / sizeof(Cell) &&
+                  (!hasDecoded ||
+                   (header.decodedInstBytes != 0 &&
+                    header.decodedOffset % sectionAlignment == 0 &&
+                    header.decodedOffset <= bytes.size() &&
+                    header.nDecoded <= (bytes.size() - header.decodedOffset) /
+                                           header.decodedInstBytes)),
+              path + ": sections out of the file");
+  constexpr size_t nCells = RAMBase<Addr, Cell>::nCells;
+  SHISA_CHECK(header.dataEnd <= header.binEnd &&
+                  header.binEnd <= header.imageCells &&
+                  header.binEnd <= std::numeric_limits<Addr>::max() &&
+                  header.imageCells <= nCells,
+              path + ": image does not fit the RAM");
+
+  const uint64_t imageBytes   = header.imageCells * sizeof(Cell);
+  const uint64_t decodedBytes = header.nDecoded * header.decodedInstBytes;
+
+  const auto image = bytes.subspan(header.imageOffset, imageBytes);
+  const auto decoded =
+      hasDecoded ? bytes.subspan(header.decodedOffset, decodedBytes)
+                 : std::span<const std::byte>{};
+  if (check == Checksum::verify) {
+    SHISA_CHECK(program_file_detail::checksumOf(header, image, decoded) ==
+                    header.checksum,
+                path + ": checksum mismatch");
+  }
+
+  // the mapping is page aligned, and so are the sections in it
+  std::span<const DecodedInst> insts{};
+  if (hasDecoded && header.decodedInstBytes == sizeof(DecodedInst)) {
+    insts = {reinterpret_cast<const DecodedInst *>(decoded.data()),
+             header.nDecoded};
+  }
+  if (check == Checksum::verify) {
+    const bool valid = std::ranges::all_of(insts, Program::isValidDecoded);
+    SHISA_CHECK(valid, path + ": predecoded instructions out of range");
+  }
+  return Program::view({reinterpret_cast<const Cell *>(image.data()),
+                        header.imageCells},
+                       static_cast<Addr>(header.dataEnd),
+                       static_cast<Addr>(header.binEnd), insts,
+                       std::move(file));
+}
+
+} // namespace shisa::fsim
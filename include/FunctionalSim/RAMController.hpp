@@ -1,15 +1,27 @@
 #pragma once
 
+#include "StateCompare.hpp"
+
 #include <ShISA/Binary.hpp>
 #include <ShISA/ISAModule.hpp>
+#include <exceptions.hpp>
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <climits>
 #include <concepts>
+#include <cstdint>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <memory>
 #include <ostream>
+#include <span>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 
 
@@ -30,14 +42,35 @@ public:
                     !std::numeric_limits<Cell>::is_signed,
                 "cell_t must be an unsigned integer type");
 
+  static constexpr size_t nCells   = std::tuple_size_v<MemStorage>;
+  static constexpr Addr   lastAddr = std::numeric_limits<Addr>::max();
+
+  // Words of two byte cells are accessed with a single host load or store.
+  // Other configurations go cell by cell.
+  template <typename Word>
+  static constexpr bool hasWordPath =
+      std::unsigned_integral<Word> && sizeof(Cell) == 1 && sizeof(Word) == 2 &&
+      (std::endian::native == std::endian::little ||
+       std::endian::native == std::endian::big);
+
 private:
-  MemStorage storage{};
+  // The extra cell mirrors cell 0, so the word at the last address does not
+  // need to wrap around.
+  std::array<Cell, nCells + 1> storage{};
+
+  void syncGuard(Addr addr) {
+    if (addr == 0) {
+      storage[nCells] = storage[0];
+    } else if (addr == lastAddr) {
+      storage[0] = storage[nCells];
+    }
+  }
 
 public:
   void dump(std::ostream &os) const {
     os << "RAM dump\n";
     Addr addr = 0;
-    for (const auto cell : storage) {
+    for (const auto cell : *this) {
       os << "0x" << std::setw(2 * sizeof(Addr)) << std::right << std::hex
          << std::setfill('0') << addr++ << " = 0x"
          << std::setw(2 * sizeof(Cell)) << std::right << std::hex
@@ -46,23 +79,98 @@ public:
   }
 
   auto begin() { return storage.begin(); }
-  auto end() { return storage.end(); }
+  auto end() { return storage.begin() + nCells; }
 
   auto begin() const { return storage.begin(); }
-  auto end() const { return storage.end(); }
+  auto end() const { return storage.begin() + nCells; }
+
+  // Bulk stores through data() must not cover cell 0, the guard cell is
+  // not updated by them.
+  auto data() -> Cell * { return storage.data(); }
+  auto data() const -> const Cell * { return storage.data(); }
 
   auto read(Addr addr) const -> Cell { return storage[addr]; }
-  void write(Addr addr, Cell data) { storage[addr] = data; }
+  void write(Addr addr, Cell data) {
+    storage[addr] = data;
+    if (addr == 0) {
+      storage[nCells] = data;
+    }
+  }
+
+  // big-endian word at addr, wrapping around the address space
+  template <typename Word>
+  requires hasWordPath<Word>
+  auto readWord(Addr addr) const -> Word {
+    uint16_t word = 0;
+    std::memcpy(&word, storage.data() + addr, sizeof(word));
+    if constexpr (std::endian::native == std::endian::little) {
+      word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+    }
+    return word;
+  }
+
+  template <typename Word>
+  requires hasWordPath<Word>
+  void writeWord(Addr addr, Word data) {
+    auto word = static_cast<uint16_t>(data);
+    if constexpr (std::endian::native == std::endian::little) {
+      word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+    }
+    std::memcpy(storage.data() + addr, &word, sizeof(word));
+    syncGuard(addr);
+  }
 };
 
 
 
-template <typename addr_t, typename cell_t>
+// RAM that keeps the binary read-only and bounds the stack by itself, see
+// MappedRAM.hpp
+template <class RAM>
+concept isProtectedRAM = requires(RAM ram, typename RAM::Addr addr,
+                                  typename RAM::Cell data, uint16_t &word) {
+  ram.placeBinary(addr);
+  ram.writeGuest(addr, data);
+  ram.storeStackWord(addr, word);
+  ram.loadStackWord(addr, word);
+};
+
+
+
+// RAM that can map the pages of a loaded binary image shared between
+// instances, see PagedRAM.hpp
+template <class RAM>
+concept isSharingRAM =
+    requires(RAM ram, std::span<const typename RAM::Cell> image,
+             std::shared_ptr<const void> owner) {
+  ram.shareImage(image, owner);
+};
+
+
+// RAM that shares its pages copy-on-write with a fork, see PagedRAM.hpp
+template <class RAM>
+concept isForkingRAM = requires(RAM ram) {
+  { ram.fork() } -> std::same_as<RAM>;
+};
+
+// RAM whose identical pages can be merged, see PagedRAM::Deduplicator
+template <class RAM>
+concept isDeduplicatingRAM =
+    requires(RAM ram, typename RAM::Deduplicator dedup) {
+  ram.deduplicate(dedup);
+};
+
+
+
+template <typename addr_t, typename cell_t,
+          class ram_t = RAMBase<addr_t, cell_t>>
 requires(std::unsigned_integral<addr_t>
              &&std::unsigned_integral<cell_t>) class RAMControllerBase {
 public:
   using Addr = addr_t;
   using Cell = cell_t;
+  using RAM  = ram_t;
+
+  static constexpr bool isProtected = isProtectedRAM<RAM>;
 
   static constexpr bool instEndAligned =
       (sizeof(ISAModule::RawInst) % sizeof(Cell)) == 0;
@@ -74,8 +182,15 @@ public:
   static constexpr size_t cellsPerData =
       sizeof(Binary::Data) / sizeof(Cell) + (dataEndAligned ? 0 : 1);
 
+  // Watch pages are 1 KiB cells, coarser for wide addresses so that the
+  // table stays at most 1024 entries.
+  static constexpr size_t pageBits =
+      std::max<size_t>(10, std::numeric_limits<Addr>::digits - 10);
+  static constexpr size_t pageSize = static_cast<size_t>(1) << pageBits;
+  static constexpr size_t nPages =
+      (static_cast<size_t>(std::numeric_limits<Addr>::max()) >> pageBits) + 1;
+
 private:
-  using RAM = RAMBase<Addr, Cell>;
   RAM ram{};
 
   bool binaryLoaded = false;
@@ -83,8 +198,102 @@ private:
   addr_t dataEnd   = 0x0000;
   addr_t binaryEnd = 0x0000;
 
+  // Number of watchpoints covering each page. A page is also marked when a
+  // watched range starts in the first cells of the next one, so a single
+  // lookup by the first address of a multi-cell access is enough.
+  std::array<unsigned, nPages>       watchedPages{};
+  std::vector<std::pair<Addr, Addr>> watchpoints{};
+
+  // One bit per page, a single word for 16-bit addresses.
+  static constexpr size_t dirtyWordBits = 64;
+  using PageBits =
+      std::array<uint64_t, (nPages + dirtyWordBits - 1) / dirtyWordBits>;
+
+  template <typename F>
+  static void forEachPageIn(const PageBits &pages, F f) {
+    for (size_t i = 0; i < pages.size(); i++) {
+      for (uint64_t bits = pages[i]; bits != 0; bits &= bits - 1) {
+        f(i * dirtyWordBits + std::countr_zero(bits));
+      }
+    }
+  }
+
+  // pages written since the last clearDirtyPages()
+  PageBits dirtyPages{};
+
+  // The hash of a page of zero cells. A new RAM is all zero, so its page
+  // hashes start out as this one and none is stale, even when the pages
+  // of a wide RAM are gigabytes in all.
+  static auto zeroPageHash() -> uint64_t {
+    static const uint64_t hash = []() {
+      static constexpr std::array<Cell, 256> zeros{};
+      StateHasher                            hasher{};
+      for (size_t n = 0; n < std::min(pageSize, RAM::nCells);
+           n += zeros.size()) {
+        hasher.update(std::span<const Cell>{zeros});
+      }
+      return hasher.digest();
+    }();
+    return hash;
+  }
+
+  // The hash of each page and the pages written since it was taken, see
+  // hashRAM()
+  std::array<uint64_t, nPages> pageHashes = []() {
+    std::array<uint64_t, nPages> hashes{};
+    hashes.fill(zeroPageHash());
+    return hashes;
+  }();
+  PageBits staleHashes{};
+
+  void markDirty(Addr addr) {
+    const size_t   page = addr >> pageBits;
+    const uint64_t bit  = uint64_t{1} << page % dirtyWordBits;
+    dirtyPages[page / dirtyWordBits] |= bit;
+    staleHashes[page / dirtyWordBits] |= bit;
+  }
+
+  void hashStalePages(std::array<uint64_t, nPages> &hashes) const {
+    const size_t size = std::min(pageSize, RAM::nCells);
+    forEachPageIn(staleHashes, [&](size_t page) {
+      StateHasher hasher{};
+      forEachSpan(page << pageBits, size,
+                  [&](size_t /*addr*/, std::span<const Cell> cells) {
+                    hasher.update(cells);
+                  });
+      hashes[page] = hasher.digest();
+    });
+  }
+
+  static auto combinePageHashes(const std::array<uint64_t, nPages> &hashes)
+      -> uint64_t {
+    StateHasher hasher{};
+    hasher.update(std::span<const uint64_t>{hashes});
+    return hasher.digest();
+  }
+
+  template <typename F>
+  static void forEachPage(Addr first, Addr last, F f) {
+    const size_t firstPage = first >> pageBits;
+    const size_t lastPage  = last >> pageBits;
+    for (size_t page = firstPage;; page = (page + 1) % nPages) {
+      f(page);
+      if (page == lastPage) {
+        break;
+      }
+    }
+  }
+
+  static auto watchedPagesBegin(Addr first) -> Addr {
+    return first - static_cast<Addr>(cellsPerData - 1);
+  }
+
 public:
-  using MemStorage = typename RAM::MemStorage;
+  // The bulk accesses use data(), RAM in pages like PagedRAM has none and
+  // goes word by word.
+  static constexpr bool hasFlatStorage = requires(RAM r) {
+    { r.data() } -> std::same_as<Cell *>;
+  };
 
   auto begin() { return ram.begin(); }
   auto end() { return ram.end(); }
@@ -92,32 +301,151 @@ public:
   auto begin() const { return ram.begin(); }
   auto end() const { return ram.end(); }
 
+  // raw storage for bulk accesses checked with isBulkReadable() and
+  // isBulkWritable()
+  auto data() -> Cell * { return ram.data(); }
+  auto data() const -> const Cell * { return ram.data(); }
+
+  // f(addr, cells) over contiguous runs of the cells in [first, first +
+  // size), which must not wrap around. A single run for flat storage.
+  template <typename F>
+  void forEachSpan(size_t first, size_t size, F f) const {
+    if constexpr (hasFlatStorage) {
+      f(first, std::span<const Cell>{ram.data() + first, size});
+    } else {
+      ram.forEachSpan(static_cast<Addr>(first), size, f);
+    }
+  }
+
   void dump(std::ostream &os) const {
     os << "RAMController dump\n";
     ram.dump(os);
   }
 
-  void loadBin(const Binary &b) {
+  // The cells of words as laid out in RAM, big-endian, from out on. 16-bit
+  // words into byte cells are swapped whole, which compilers vectorize,
+  // rather than shifted cell by cell.
+  template <typename Raw, typename Word>
+  static void toCells(std::span<const Word> words, Cell *out) {
+    constexpr size_t cellsPerWord =
+        sizeof(Raw) / sizeof(Cell) + (sizeof(Raw) % sizeof(Cell) ? 1 : 0);
+    if constexpr (cellsPerWord == 1) {
+      for (size_t i = 0; i < words.size(); i++) {
+        out[i] = static_cast<Cell>(static_cast<Raw>(words[i]));
+      }
+    } else if constexpr (sizeof(Raw) == 2 && sizeof(Cell) == 1) {
+      for (size_t i = 0; i < words.size(); i++) {
+        auto word = static_cast<uint16_t>(static_cast<Raw>(words[i]));
+        if constexpr (std::endian::native == std::endian::little) {
+          word = static_cast<uint16_t>(word << CHAR_BIT | word >> CHAR_BIT);
+        }
+        std::memcpy(out + 2 * i, &word, sizeof(word));
+      }
+    } else {
+      for (const auto word : words) {
+        for (int i = cellsPerWord - 1; i >= 0; i--) {
+          *out++ = static_cast<Cell>(static_cast<Raw>(word) >>
+                                     (i * sizeof(Cell) * CHAR_BIT) &
+                                     std::numeric_limits<cell_t>::max());
+        }
+      }
+    }
+  }
+
+  // f(addr, cell) for the cells of the binary as they are laid out in RAM,
+  // data first. Returns the end of the data and the end of the binary.
+  template <typename F>
+  static auto splitBinary(BinaryView b, F f) -> std::pair<Addr, Addr> {
     addr_t currAddr = 0;
 
     for (const auto data : b.getRawData()) {
       for (int i = cellsPerData - 1; i >= 0; i--) {
-        ram.write(currAddr++, (data >> (i * sizeof(Cell) * CHAR_BIT)) &
-                                  std::numeric_limits<cell_t>::max());
+        f(currAddr++, (data >> (i * sizeof(Cell) * CHAR_BIT)) &
+                          std::numeric_limits<cell_t>::max());
       }
     }
 
-    dataEnd = currAddr;
+    const addr_t dataEndAddr = currAddr;
 
-    for (const auto inst : b.getISAModule()) {
+    for (const auto inst : b.getInsts()) {
       for (int i = cellsPerInst - 1; i >= 0; i--) {
-        ram.write(currAddr++, (inst >> (i * sizeof(Cell) * CHAR_BIT)) &
-                                  std::numeric_limits<cell_t>::max());
+        f(currAddr++, (inst >> (i * sizeof(Cell) * CHAR_BIT)) &
+                          std::numeric_limits<cell_t>::max());
       }
     }
 
-    binaryEnd    = currAddr;
+    return {dataEndAddr, currAddr};
+  }
+
+  // The number of cells of the binary, which must fit the address space.
+  static auto binaryCells(BinaryView b) -> size_t {
+    const size_t cells = b.nData() * cellsPerData + b.nInsts() * cellsPerInst;
+    SHISA_CHECK(cells <= std::numeric_limits<Addr>::max(),
+                "binary doesn't fit the address space");
+    return cells;
+  }
+
+  // Flat storage takes the words in bulk, see toCells().
+  void loadBin(BinaryView b) {
+    if constexpr (hasFlatStorage) {
+      binaryEnd = static_cast<Addr>(binaryCells(b));
+      dataEnd   = static_cast<Addr>(b.nData() * cellsPerData);
+      toCells<Binary::Data>(b.getRawData(), data());
+      toCells<ISAModule::RawInst>(b.getInsts(), data() + dataEnd);
+      // keeps the guard cell of RAMBase in sync
+      ram.write(0, ram.read(0));
+    } else {
+      std::tie(dataEnd, binaryEnd) = splitBinary(
+          b, [this](Addr addr, Cell cell) { ram.write(addr, cell); });
+    }
+    binaryLoaded = true;
+    markDirty(0, binaryEnd);
+
+    if constexpr (isProtected) {
+      ram.placeBinary(binaryEnd);
+    }
+  }
+
+  // Same as loadBin() from the cells of a binary split beforehand. RAM
+  // that can share the image, like PagedRAM, maps its pages instead of
+  // copying them and keeps owner alive.
+  void loadImage(std::span<const Cell> image, Addr dataEndAddr, Addr binEnd,
+                 std::shared_ptr<const void> owner) {
+    if constexpr (isSharingRAM<RAM>) {
+      ram.shareImage(image, std::move(owner));
+    } else if constexpr (hasFlatStorage) {
+      std::copy_n(image.data(), binEnd, data());
+      // keeps the guard cell of RAMBase in sync
+      ram.write(0, ram.read(0));
+    } else {
+      for (size_t addr = 0; addr < binEnd; addr++) {
+        ram.write(static_cast<Addr>(addr), image[addr]);
+      }
+    }
+    dataEnd      = dataEndAddr;
+    binaryEnd    = binEnd;
     binaryLoaded = true;
+    markDirty(0, binaryEnd);
+
+    if constexpr (isProtected) {
+      ram.placeBinary(binaryEnd);
+    }
+  }
+
+  // Replaces the data section of the loaded binary, the only way to write
+  // into it. The instructions are kept, so data must not be longer than the
+  // original one.
+  void loadData(std::span<const Binary::Data> data) {
+    SHISA_CHECK(data.size() * cellsPerData <= dataEnd,
+                "data doesn't fit the data section");
+    addr_t currAddr = 0;
+    for (const auto word : data) {
+      for (int i = cellsPerData - 1; i >= 0; i--) {
+        ram.write(currAddr++, (word >> (i * sizeof(Cell) * CHAR_BIT)) &
+                                  std::numeric_limits<cell_t>::max());
+      }
+    }
+    markDirty(0, currAddr);
   }
 
   [[nodiscard]] auto getProgramStart() const -> Addr { return dataEnd; }
@@ -133,11 +461,236 @@ public:
   auto read(addr_t addr) const -> cell_t { return ram.read(addr); }
 
   void write(addr_t addr, cell_t data) {
+    if constexpr (isProtected) {
+      // the RAM drops the stores into the binary, they dirty nothing
+      ram.writeGuest(addr, data);
+      if (addr >= binaryEnd) {
+        markDirty(addr);
+      }
+      return;
+    }
     // binary is loaded in read-only memory
     if (addr >= binaryEnd) {
       ram.write(addr, data);
+      markDirty(addr);
     }
   }
+
+  template <typename Word>
+  static constexpr bool hasWordPath = RAM::template hasWordPath<Word>;
+
+  template <typename Word>
+  requires hasWordPath<Word>
+  auto readWord(Addr addr) const -> Word {
+    return ram.template readWord<Word>(addr);
+  }
+
+  // Same as writing the cells one by one. Both cells are writable iff addr
+  // is in [binaryEnd, lastAddr), which is a single unsigned compare.
+  template <typename Word>
+  requires hasWordPath<Word>
+  void writeWord(Addr addr, Word data) {
+    if constexpr (isProtected) {
+      ram.writeWordGuest(addr, data);
+      for (const Addr cell : {addr, static_cast<Addr>(addr + 1)}) {
+        if (cell >= binaryEnd) {
+          markDirty(cell);
+        }
+      }
+      return;
+    }
+    if (static_cast<Addr>(addr - binaryEnd) <
+        static_cast<Addr>(RAM::lastAddr - binaryEnd)) [[likely]] {
+      ram.template writeWord<Word>(addr, data);
+      markDirty(addr);
+      markDirty(static_cast<Addr>(addr + 1));
+      return;
+    }
+    write(addr, static_cast<Cell>(data >> CHAR_BIT));
+    write(addr + 1, static_cast<Cell>(data));
+  }
+
+  // Words on the stack, [binaryEnd, binaryEnd + STACK_OFFSET), with no bound
+  // checks. They return false with nothing touched for any other word and
+  // always without a protected RAM.
+  template <typename Word>
+  auto storeStackWord(Addr addr, Word data) -> bool {
+    if constexpr (isProtected) {
+      if (ram.storeStackWord(addr, data)) {
+        markDirty(addr);
+        markDirty(static_cast<Addr>(addr + sizeof(Word) / sizeof(Cell) - 1));
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template <typename Word>
+  auto loadStackWord(Addr addr, Word &data) const -> bool {
+    if constexpr (isProtected) {
+      return ram.loadStackWord(addr, data);
+    }
+    return false;
+  }
+
+  // watched range is [addr, addr + size), wrapping around the address space
+  void addWatchpoint(Addr addr, size_t size = 1) {
+    SHISA_CHECK(size != 0, "watchpoint of zero size");
+    const Addr last = addr + static_cast<Addr>(size - 1);
+    watchpoints.emplace_back(addr, last);
+    forEachPage(watchedPagesBegin(addr), last,
+                [this](size_t page) { watchedPages[page]++; });
+  }
+
+  void removeWatchpoint(Addr addr, size_t size = 1) {
+    const Addr last = addr + static_cast<Addr>(size - 1);
+    auto       it   = std::find(watchpoints.begin(), watchpoints.end(),
+                                std::pair{addr, last});
+    if (it == watchpoints.end()) {
+      return;
+    }
+    watchpoints.erase(it);
+    forEachPage(watchedPagesBegin(addr), last,
+                [this](size_t page) { watchedPages[page]--; });
+  }
+
+  void clearWatchpoints() {
+    watchpoints.clear();
+    watchedPages.fill(0);
+  }
+
+  [[nodiscard]] auto isPageWatched(Addr addr) const -> bool {
+    return watchedPages[addr >> pageBits] != 0;
+  }
+
+  // Pages of pageSize cells written since the last clearDirtyPages(). The
+  // loaded binary counts as written. Bulk stores through data() have to
+  // be reported with markDirty().
+  void markDirty(Addr addr, size_t size) {
+    if (size != 0) {
+      forEachPage(addr, addr + static_cast<Addr>(size - 1),
+                  [this](size_t page) {
+                    markDirty(static_cast<Addr>(page << pageBits));
+                  });
+    }
+  }
+
+  [[nodiscard]] auto isPageDirty(Addr addr) const -> bool {
+    const size_t page = addr >> pageBits;
+    return (dirtyPages[page / dirtyWordBits] >> page % dirtyWordBits) & 1;
+  }
+
+  // f(first) for the first address of each dirty page, in address order
+  template <typename F>
+  void forEachDirtyPage(F f) const {
+    forEachPageIn(dirtyPages, [&](size_t page) {
+      f(static_cast<Addr>(page << pageBits));
+    });
+  }
+
+  void clearDirtyPages() { dirtyPages.fill(0); }
+
+  // Hash of the cells, combined from per-page hashes of which only the
+  // ones of the pages written since the last non-const call are computed
+  // again. That call keeps the page hashes, the const one computes the
+  // stale ones into a copy, so several threads may hash a const controller.
+  [[nodiscard]] auto hashRAM() -> uint64_t {
+    hashStalePages(pageHashes);
+    staleHashes.fill(0);
+    return combinePageHashes(pageHashes);
+  }
+
+  [[nodiscard]] auto hashRAM() const -> uint64_t {
+    auto hashes = pageHashes;
+    hashStalePages(hashes);
+    return combinePageHashes(hashes);
+  }
+
+  // Copies the dirty pages back from image, a controller with the same
+  // binary loaded, and clears the dirty bits. The cells of the clean pages
+  // must already match image.
+  void restoreDirtyPages(const RAMControllerBase &image) {
+    SHISA_CHECK(binaryEnd == image.binaryEnd && dataEnd == image.dataEnd,
+                "RAM image of another binary");
+    for (size_t i = 0; i < dirtyPages.size(); i++) {
+      staleHashes[i] |= dirtyPages[i];
+    }
+    const size_t size = std::min(pageSize, RAM::nCells);
+    forEachDirtyPage([&](Addr first) {
+      if constexpr (hasFlatStorage) {
+        std::memcpy(ram.data() + first, image.ram.data() + first,
+                    size * sizeof(Cell));
+      } else {
+        // unchanged cells are not written, so shared pages stay shared
+        for (size_t i = 0; i < size; i++) {
+          const auto addr = static_cast<Addr>(first + i);
+          if (ram.read(addr) != image.ram.read(addr)) {
+            ram.write(addr, image.ram.read(addr));
+          }
+        }
+      }
+    });
+    if constexpr (hasFlatStorage) {
+      // keeps the guard cell of RAMBase in sync
+      ram.write(0, ram.read(0));
+    }
+    clearDirtyPages();
+  }
+
+  template <class Deduplicator>
+  void deduplicate(Deduplicator &dedup) {
+    ram.deduplicate(dedup);
+  }
+
+  // Takes the state of parent. RAM like PagedRAM shares the pages with it
+  // copy-on-write, any other RAM is copied.
+  void forkFrom(RAMControllerBase &parent) {
+    if constexpr (isForkingRAM<RAM>) {
+      ram = parent.ram.fork();
+    } else {
+      ram = parent.ram;
+    }
+    binaryLoaded = parent.binaryLoaded;
+    dataEnd      = parent.dataEnd;
+    binaryEnd    = parent.binaryEnd;
+    watchedPages = parent.watchedPages;
+    watchpoints  = parent.watchpoints;
+    dirtyPages   = parent.dirtyPages;
+    pageHashes   = parent.pageHashes;
+    staleHashes  = parent.staleHashes;
+  }
+
+  // [addr, addr + size) does not wrap around the address space
+  [[nodiscard]] static auto isBulkReadable(Addr addr, size_t size) -> bool {
+    return static_cast<size_t>(addr) + size <=
+           static_cast<size_t>(std::numeric_limits<Addr>::max()) + 1;
+  }
+
+  // [addr, addr + size) does not wrap around, is outside of the read-only
+  // binary and has no watched pages, so a bulk store behaves exactly as
+  // a sequence of write() calls. Cell 0 is excluded for the guard cell.
+  [[nodiscard]] auto isBulkWritable(Addr addr, size_t size) const -> bool {
+    if (addr < binaryEnd || addr == 0 || !isBulkReadable(addr, size)) {
+      return false;
+    }
+    const size_t lastPage = (static_cast<size_t>(addr) + size - 1) >> pageBits;
+    for (size_t page = addr >> pageBits; page <= lastPage; page++) {
+      if (watchedPages[page] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  [[nodiscard]] auto isWatched(Addr addr) const -> bool {
+    return std::any_of(watchpoints.begin(), watchpoints.end(),
+                       [addr](const auto &range) {
+                         const auto [first, last] = range;
+                         return first <= last
+                                    ? (first <= addr && addr <= last)
+                                    : (first <= addr || addr <= last);
+                       });
+  }
 };
 
 } // namespace shisa::fsim
@@ -1,48 +1,244 @@
 #pragma once
 
 #include "CPU.hpp"
+#include "EventQueue.hpp"
+#include "LoadedProgram.hpp"
 
 #include <ShISA/Binary.hpp>
 #include <ShISA/ISAModule.hpp>
 #include <exceptions.hpp>
 
 #include <array>
+#include <atomic>
 #include <concepts>
 #include <iomanip>
 #include <limits>
+#include <memory>
 #include <ostream>
+#include <span>
+#include <utility>
+#include <vector>
 
 
 
 namespace shisa::fsim {
 
-template <typename reg_t, typename addr_t, typename cell_t, size_t n_regs>
+template <typename reg_t, typename addr_t, typename cell_t, size_t n_regs,
+          class ram_t = RAMBase<addr_t, cell_t>>
 requires(std::unsigned_integral<Reg> &&std::unsigned_integral<Addr>
              &&std::unsigned_integral<Cell>) class SimBase {
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
+  using RAM  = ram_t;
 
-  using CPU = CpuBase<Reg, Addr, Cell, n_regs>;
+  using CPU     = CpuBase<Reg, Addr, Cell, n_regs, RAM>;
+  using Program = LoadedProgramBase<Addr, Cell>;
+
+  using EventQueue = EventQueueBase<Addr>;
+  using Tick       = typename EventQueue::Tick;
+  using Event      = typename EventQueue::Event;
 
 private:
+  std::shared_ptr<const Program> program;
+
   CPU cpu;
 
+  // Retired instructions are accounted per straight-line block when control
+  // leaves it, so nothing is counted per instruction.
+  Tick retired    = 0;
+  Addr blockStart = 0;
+
+  EventQueue events{};
+
+  std::atomic<bool> stopRequest{false};
+  // earliest retired count at which a block exit has to look at the events
+  // and the stop request; zero while a stop is requested
+  std::atomic<Tick> deadline{EventQueue::never};
+
+  void updateDeadline() {
+    deadline.store(events.nextDeadline());
+    if (stopRequest.load()) {
+      deadline.store(0);
+    }
+  }
+
+  void checkStopRequest() {
+    if (stopRequest.exchange(false)) {
+      throw StopRequested{};
+    }
+  }
+
+  // The event is taken like a CALL from the start of the entered block, so
+  // the handler returns to it with a plain RET.
+  void deliverEvent(const typename EventQueue::Event &event) {
+    cpu.storePCOnStack();
+    cpu.storeRegsOnStack();
+    cpu.setPC(event.entry);
+    enterBlock();
+    cpu.checkWatchpoints();
+  }
+
 protected:
   auto getState() -> CPU & { return cpu; }
 
+  [[nodiscard]] auto getProgram() const -> const Program & { return *program; }
+
+  void handleDeadline() {
+    checkStopRequest();
+    while (events.isDue(retired)) {
+      deliverEvent(events.pop());
+    }
+    updateDeadline();
+  }
+
+  // for engines that keep PC in a host local and account blocks themselves
+  void retire(Tick nInsts) { retired += nInsts; }
+
+  [[nodiscard]] auto isDeadlineReached() const -> bool {
+    return retired >= deadline.load(std::memory_order_relaxed);
+  }
+
+  void leaveBlock() {
+    retired += (cpu.getPC() - blockStart) / CPU::cellsPerInst;
+  }
+
+  void enterBlock() { blockStart = cpu.getPC(); }
+
+  // for the fork() of the engines, they construct a sim of the same
+  // program and take the state of the parent with this
+  [[nodiscard]] auto shareProgram() const -> std::shared_ptr<const Program> {
+    return program;
+  }
+
+  // Everything but the stop request is taken from parent, the RAM pages
+  // are shared copy-on-write where the RAM can do it. Must not race with
+  // a running parent.
+  void forkFrom(SimBase &parent) {
+    cpu.forkFrom(parent.cpu);
+    retired    = parent.retired;
+    blockStart = parent.blockStart;
+    events     = parent.events;
+    stopRequest.store(false);
+    updateDeadline();
+  }
+
+  // Polled on block entry after taken branches, CALL and RET only, so
+  // straight-line code pays nothing for events and stop requests.
+  void checkDeadline() {
+    if (isDeadlineReached()) [[unlikely]] {
+      handleDeadline();
+    }
+  }
+
 public:
-  SimBase(const Binary &b) { cpu.loadBin(b); }
+  SimBase(BinaryView b) : SimBase{Program::load(b)} {}
+
+  // Sims of the same program share its image and predecoded code.
+  explicit SimBase(std::shared_ptr<const Program> p) : program{std::move(p)} {
+    cpu.loadProgram(program);
+    enterBlock();
+  }
 
   void dump(std::ostream &os) const { cpu.dump(os); }
 
   auto getState() const -> const CPU & { return cpu; }
 
+  // Back to the state right after construction, with image the CPU state
+  // at that point. Only the RAM pages written since are copied. Events and
+  // watchpoints are dropped, the predecoded program of the engine is kept.
+  // Must not race with a running sim.
+  void reset(const CPU &image) {
+    cpu.resetTo(image);
+    cpu.clearWatchpoints();
+    retired = 0;
+    events.clear();
+    stopRequest.store(false);
+    updateDeadline();
+    enterBlock();
+  }
+
+  // Same as reset(image) with a CPU that has just loaded the program as
+  // image, which is built for the call, so keep one for repeated resets.
+  void reset() {
+    const auto image = std::make_unique<CPU>();
+    image->loadProgram(program);
+    reset(*image);
+  }
+
+  // Sets the state with load(cpu), which returns the instructions retired
+  // up to that state, e.g. for restoreCheckpoint(). Meant for a sim that
+  // has not run yet or is reset by load, e.g. with reset().
+  template <typename F>
+  void restoreState(F load) {
+    retired = load(cpu);
+    updateDeadline();
+    enterBlock();
+  }
+
+  // Replaces the data section of the binary, see CPU::loadData(). Meant
+  // for a sim that has not run yet, e.g. right after reset().
+  void loadData(std::span<const Binary::Data> data) { cpu.loadData(data); }
+
+  // Shares the RAM pages equal to ones dedup has seen in other sims, see
+  // PagedRAM::Deduplicator. Must not race with this sim running.
+  template <class Deduplicator>
+  void deduplicatePages(Deduplicator &dedup) {
+    cpu.deduplicatePages(dedup);
+  }
+
+  // Stores into [addr, addr + size) stop execution with shisa::Watchpoint
+  // after the storing instruction is complete, so executeAll() can resume.
+  void addWatchpoint(Addr addr, size_t size = 1) {
+    cpu.addWatchpoint(addr, size);
+  }
+
+  void removeWatchpoint(Addr addr, size_t size = 1) {
+    cpu.removeWatchpoint(addr, size);
+  }
+
+  void clearWatchpoints() { cpu.clearWatchpoints(); }
+
+  // May be called from any thread. The running executeAll() throws
+  // shisa::StopRequested at the next taken branch, CALL or RET, leaving the
+  // state consistent; calling executeAll() again resumes execution.
+  void requestStop() {
+    stopRequest.store(true);
+    deadline.store(0);
+  }
+
+  [[nodiscard]] auto isStopRequested() const -> bool {
+    return stopRequest.load();
+  }
+
+  [[nodiscard]] auto retiredInsts() const -> Tick {
+    return retired + (cpu.getPC() - blockStart) / CPU::cellsPerInst;
+  }
+
+  // Schedules a guest interrupt: once retiredInsts() reaches the deadline,
+  // the next block exit stores PC and registers on the stack as CALL does
+  // and jumps to entry. Events are checked at block exits only, so delivery
+  // may be late by up to one block. Must not race with a running sim.
+  void scheduleEvent(Tick at, Addr entry, Tick period = 0) {
+    events.schedule(at, entry, period);
+    updateDeadline();
+  }
+
+  void clearEvents() {
+    events.clear();
+    updateDeadline();
+  }
+
+  // the scheduled events in the order they are due, e.g. for checkpoints
+  [[nodiscard]] auto pendingEvents() const -> std::vector<Event> {
+    return events.pending();
+  }
+
 
   virtual void executeOne() = 0;
 
-  void executeAll() {
+  virtual void executeAll() {
     while (!cpu.endReached()) {
       executeOne();
     }
@@ -70,7 +266,9 @@ public:
   void processDiv(int dstReg, int srcLReg, int srcRReg) {
     Reg rReg = cpu.readReg(srcRReg);
     if (rReg == 0) {
+      leaveBlock();
       cpu.setPCToEnd();
+      enterBlock();
       // TODO: maybe need to write about exception somewhere in MMIO
       return;
     }
@@ -108,7 +306,10 @@ public:
     Reg cond = cpu.readReg(srcLReg);
     if (cond == 0) {
       Reg jmpTo = cpu.readReg(srcRReg);
+      leaveBlock();
       cpu.setPC(jmpTo);
+      enterBlock();
+      checkDeadline();
     }
   }
 
@@ -121,10 +322,12 @@ public:
     Reg addr = cpu.readReg(srcLReg);
     Reg data = cpu.readReg(srcRReg);
     cpu.writeWordToRAM(addr, data);
+    cpu.checkWatchpoints();
   }
 
   void processPush(int /*dstReg*/, int srcLReg, int /*srcRReg*/) {
     cpu.storeRegOnStack(srcLReg);
+    cpu.checkWatchpoints();
   }
 
   void processPop(int dstReg, int /*srcLReg*/, int /*srcRReg*/) {
@@ -135,18 +338,32 @@ public:
     Reg jmpTo = cpu.readReg(dstReg);
     cpu.storePCOnStack();
     cpu.storeRegsOnStack();
+    leaveBlock();
     cpu.setPC(jmpTo);
+    enterBlock();
+    cpu.checkWatchpoints();
+    checkDeadline();
   }
 
   void processRet(int /*dstReg*/, int /*srcLReg*/, int /*srcRReg*/) {
     cpu.loadRegsFromStack();
+    leaveBlock();
     cpu.loadPCFromStack();
+    enterBlock();
+    checkDeadline();
   }
 };
 
 #define USING_SIM_BASE(sim_base_alias)                                         \
   using sim_base_alias::dump;                                                  \
   using sim_base_alias::getState;                                              \
+  using sim_base_alias::getProgram;                                            \
+  using sim_base_alias::leaveBlock;                                            \
+  using sim_base_alias::enterBlock;                                            \
+  using sim_base_alias::checkDeadline;                                         \
+  using sim_base_alias::handleDeadline;                                        \
+  using sim_base_alias::retire;                                                \
+  using sim_base_alias::isDeadlineReached;                                     \
   using sim_base_alias::executeAll;                                            \
   using sim_base_alias::fetchNext;                                             \
   using sim_base_alias::PCIncrement;                                           \
@@ -0,0 +1,248 @@
+#pragma once
+
+#include "RAMController.hpp"
+
+#include <ShISA/Binary.hpp>
+#include <exceptions.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+
+
+namespace shisa::fsim {
+
+// Bump allocator over large chunks that are never given back one by one.
+// On Linux the chunks are 2 MiB aligned anonymous mappings advised for
+// transparent huge pages, so the RAM of the objects in them takes a few TLB
+// entries; elsewhere they come from the aligned operator new.
+class HugePageArena {
+public:
+  static constexpr size_t hugePageSize = static_cast<size_t>(2) << 20;
+
+private:
+  struct Chunk {
+    void  *base;
+    size_t size;
+  };
+
+  std::vector<Chunk> chunks{};
+  std::byte         *next = nullptr;
+  std::byte         *end  = nullptr;
+
+  static auto roundUp(size_t size, size_t alignment) -> size_t {
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+  static auto allocateChunk(size_t size) -> void * {
+#if defined(__linux__)
+    // over-allocated by a huge page to align the start
+    const size_t reserved = size + hugePageSize;
+    void *map = mmap(nullptr, reserved, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    SHISA_CHECK(map != MAP_FAILED, "can't map an arena chunk");
+    const auto addr    = reinterpret_cast<uintptr_t>(map);
+    const auto aligned = roundUp(addr, hugePageSize);
+    if (aligned != addr) {
+      munmap(map, aligned - addr);
+    }
+    const uintptr_t tail = aligned + size;
+    munmap(reinterpret_cast<void *>(tail), addr + reserved - tail);
+    madvise(reinterpret_cast<void *>(aligned), size, MADV_HUGEPAGE);
+    return reinterpret_cast<void *>(aligned);
+#else
+    return ::operator new(size, std::align_val_t{hugePageSize});
+#endif
+  }
+
+  static void freeChunk(const Chunk &chunk) {
+#if defined(__linux__)
+    munmap(chunk.base, chunk.size);
+#else
+    ::operator delete(chunk.base, std::align_val_t{hugePageSize});
+#endif
+  }
+
+public:
+  HugePageArena() = default;
+
+  HugePageArena(const HugePageArena &)                     = delete;
+  auto operator=(const HugePageArena &) -> HugePageArena & = delete;
+
+  ~HugePageArena() {
+    for (const Chunk &chunk : chunks) {
+      freeChunk(chunk);
+    }
+  }
+
+  auto allocate(size_t size, size_t alignment) -> void * {
+    auto *start = reinterpret_cast<std::byte *>(
+        roundUp(reinterpret_cast<uintptr_t>(next), alignment));
+    if (next == nullptr || start + size > end) {
+      const size_t chunkSize = roundUp(size, hugePageSize);
+      void        *base      = allocateChunk(chunkSize);
+      chunks.push_back({base, chunkSize});
+      start = static_cast<std::byte *>(base);
+      end   = start + chunkSize;
+    }
+    next = start + size;
+    return start;
+  }
+};
+
+
+
+// Sims of one binary kept for reuse. A released sim is reset to the state
+// right after loading the binary by copying back only the RAM pages it
+// wrote, so acquiring one skips the RAM initialization and the binary
+// load. All the sims share one loaded program. The sims live in a
+// HugePageArena. May be used from several threads.
+template <class Sim>
+class SimPool {
+public:
+  using CPU     = typename Sim::CPU;
+  using Program = typename Sim::Program;
+  using Data    = Binary::Data;
+
+  // The sim is given back to the pool when the lease is destroyed.
+  class Lease {
+    SimPool *pool = nullptr;
+    Sim     *sim  = nullptr;
+
+    friend class SimPool;
+
+    Lease(SimPool *p, Sim *s) : pool{p}, sim{s} {}
+
+  public:
+    Lease(const Lease &)                     = delete;
+    auto operator=(const Lease &) -> Lease & = delete;
+
+    Lease(Lease &&other) noexcept
+        : pool{std::exchange(other.pool, nullptr)},
+          sim{std::exchange(other.sim, nullptr)} {}
+
+    auto operator=(Lease &&other) noexcept -> Lease & {
+      if (this != &other) {
+        release();
+        pool = std::exchange(other.pool, nullptr);
+        sim  = std::exchange(other.sim, nullptr);
+      }
+      return *this;
+    }
+
+    ~Lease() { release(); }
+
+    void release() {
+      if (sim) {
+        pool->release(std::exchange(sim, nullptr));
+      }
+    }
+
+    auto operator*() const -> Sim & { return *sim; }
+    auto operator->() const -> Sim * { return sim; }
+  };
+
+private:
+  const std::shared_ptr<const Program> program;
+
+  // the state every sim is reset to
+  const CPU image;
+
+  mutable std::mutex mutex{};
+  HugePageArena      arena{};
+  std::vector<Sim *> sims{};
+  std::vector<Sim *> idle{};
+
+  static auto loadImage(const std::shared_ptr<const Program> &p) -> CPU {
+    CPU cpu{};
+    cpu.loadProgram(p);
+    cpu.clearDirtyPages();
+    return cpu;
+  }
+
+  void release(Sim *sim) {
+    sim->reset(image);
+    const std::lock_guard lock{mutex};
+    idle.push_back(sim);
+  }
+
+public:
+  explicit SimPool(BinaryView bin) : SimPool{Program::load(bin)} {}
+
+  explicit SimPool(std::shared_ptr<const Program> p)
+      : program{std::move(p)}, image{loadImage(program)} {}
+
+  SimPool(const SimPool &)                     = delete;
+  auto operator=(const SimPool &) -> SimPool & = delete;
+
+  // all the leases must be released by now
+  ~SimPool() {
+    for (Sim *sim : sims) {
+      sim->~Sim();
+    }
+  }
+
+  auto acquire() -> Lease {
+    const std::lock_guard lock{mutex};
+    if (!idle.empty()) {
+      Sim *sim = idle.back();
+      idle.pop_back();
+      return Lease{this, sim};
+    }
+    void *place = arena.allocate(sizeof(Sim), alignof(Sim));
+    Sim  *sim   = new (place) Sim{program};
+    sims.push_back(sim);
+    return Lease{this, sim};
+  }
+
+  // for runs that differ in the input only, see SimBase::loadData()
+  auto acquire(std::span<const Data> data) -> Lease {
+    Lease lease = acquire();
+    lease->loadData(data);
+    return lease;
+  }
+
+  // One deduplication pass over the RAM of the idle sims, see
+  // PagedRAM::Deduplicator. Sims acquired meanwhile are new ones, so it
+  // may run on a background thread while the leased sims keep running.
+  auto deduplicate() requires isDeduplicatingRAM<typename Sim::RAM> {
+    std::vector<Sim *> batch{};
+    {
+      const std::lock_guard lock{mutex};
+      std::swap(batch, idle);
+    }
+
+    typename Sim::RAM::Deduplicator dedup{};
+    for (Sim *sim : batch) {
+      sim->deduplicatePages(dedup);
+    }
+
+    const std::lock_guard lock{mutex};
+    idle.insert(idle.end(), batch.begin(), batch.end());
+    return dedup.getStats();
+  }
+
+  [[nodiscard]] auto size() const -> size_t {
+    const std::lock_guard lock{mutex};
+    return sims.size();
+  }
+
+  [[nodiscard]] auto getImage() const -> const CPU & { return image; }
+
+  [[nodiscard]] auto getProgram() const
+      -> const std::shared_ptr<const Program> & {
+    return program;
+  }
+};
+
+} // namespace shisa::fsim
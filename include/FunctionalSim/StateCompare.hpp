@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <vector>
+
+
+
+// Comparison, hashing and diffing of RAM cells and whole CPU states. The
+// kernels work on contiguous spans of cells: equality goes through memcmp
+// and the hash mixes four independent 64-bit lanes, so both run at the
+// speed of the host vector units. The state functions walk the RAM in the
+// runs given by CpuBase::forEachRAMSpan(), so RAM in pages like PagedRAM
+// works too, and pages shared by two states are not read at all. The
+// state hash is kept by the CPU itself, see CpuBase::stateHash().
+
+
+
+namespace shisa::fsim {
+
+// cells [first, first + size) differ
+struct DiffRange {
+  size_t first;
+  size_t size;
+
+  auto operator==(const DiffRange &) const -> bool = default;
+};
+
+template <typename Cell>
+[[nodiscard]] auto cellsEqual(std::span<const Cell> a, std::span<const Cell> b)
+    -> bool {
+  return a.size() == b.size() &&
+         (a.data() == b.data() ||
+          std::memcmp(a.data(), b.data(), a.size_bytes()) == 0);
+}
+
+// index of the first cell that differs, the smaller size if none
+template <typename Cell>
+[[nodiscard]] auto firstDifference(std::span<const Cell> a,
+                                   std::span<const Cell> b) -> size_t {
+  const size_t n = std::min(a.size(), b.size());
+  if (a.data() == b.data()) {
+    return n;
+  }
+  // memcmp finds the block, the cells are only looked at inside it
+  constexpr size_t block = std::max<size_t>(64 / sizeof(Cell), 1);
+  size_t           i     = 0;
+  while (i + block <= n &&
+         std::memcmp(a.data() + i, b.data() + i, block * sizeof(Cell)) == 0) {
+    i += block;
+  }
+  while (i < n && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+// Appends the runs of differing cells to ranges, with base the address of
+// the first cell. A run that continues the last range extends it.
+template <typename Cell>
+void diffCells(std::span<const Cell> a, std::span<const Cell> b, size_t base,
+               std::vector<DiffRange> &ranges) {
+  const size_t n = std::min(a.size(), b.size());
+  for (size_t i = firstDifference(a, b); i < n;
+       i += firstDifference(a.subspan(i), b.subspan(i))) {
+    size_t end = i + 1;
+    while (end < n && a[end] != b[end]) {
+      end++;
+    }
+    if (!ranges.empty() &&
+        ranges.back().first + ranges.back().size == base + i) {
+      ranges.back().size += end - i;
+    } else {
+      ranges.push_back({base + i, end - i});
+    }
+    i = end;
+  }
+}
+
+// Streaming 64-bit hash of bytes. The result depends on the bytes only,
+// not on how they are split between update() calls.
+class StateHasher {
+  static constexpr size_t   nLanes = 4;
+  static constexpr size_t   block  = nLanes * sizeof(uint64_t);
+  static constexpr uint64_t prime1 = 0x9e3779b185ebca87;
+  static constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4f;
+
+  std::array<uint64_t, nLanes> lanes = {prime1, prime2, ~prime1, ~prime2};
+  std::array<std::byte, block> tail{};
+  size_t                       tailSize = 0;
+  uint64_t                     length   = 0;
+
+  void consume(const std::byte *bytes) {
+    for (size_t k = 0; k < nLanes; k++) {
+      uint64_t word = 0;
+      std::memcpy(&word, bytes + k * sizeof(word), sizeof(word));
+      lanes[k] = std::rotl(lanes[k] ^ word * prime2, 31) * prime1;
+    }
+  }
+
+  static auto mix(uint64_t h) -> uint64_t {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53;
+    h ^= h >> 33;
+    return h;
+  }
+
+public:
+  void update(const void *data, size_t size) {
+    const auto *bytes = static_cast<const std::byte *>(data);
+    length += size;
+    if (tailSize != 0) {
+      const size_t n = std::min(block - tailSize, size);
+      std::memcpy(tail.data() + tailSize, bytes, n);
+      tailSize += n;
+      bytes += n;
+      size -= n;
+      if (tailSize < block) {
+        return;
+      }
+      consume(tail.data());
+      tailSize = 0;
+    }
+    for (; size >= block; bytes += block, size -= block) {
+      consume(bytes);
+    }
+    std::memcpy(tail.data(), bytes, size);
+    tailSize = size;
+  }
+
+  template <typename T>
+  void update(std::span<const T> values) {
+    update(values.data(), values.size_bytes());
+  }
+
+  template <typename T>
+  requires std::integral<T>
+  void update(T value) { update(&value, sizeof(value)); }
+
+  [[nodiscard]] auto digest() const -> uint64_t {
+    uint64_t h = length;
+    for (const uint64_t lane : lanes) {
+      h = mix(h ^ lane) * prime1;
+    }
+    for (size_t i = 0; i < tailSize; i++) {
+      h = mix(h ^ static_cast<uint64_t>(tail[i])) * prime2;
+    }
+    return mix(h);
+  }
+};
+
+template <typename Cell>
+[[nodiscard]] auto hashCells(std::span<const Cell> cells) -> uint64_t {
+  StateHasher hasher{};
+  hasher.update(cells);
+  return hasher.digest();
+}
+
+
+
+// f(addr, a cells, b cells) over [first, first + size) of both RAMs in runs
+// contiguous in both
+template <class CPU, typename F>
+void forEachRAMSpanPair(const CPU &a, const CPU &b, size_t first, size_t size,
+                        F f) {
+  using Cell = typename CPU::Cell;
+  a.forEachRAMSpan(first, size, [&](size_t addrA, std::span<const Cell> inA) {
+    b.forEachRAMSpan(addrA, inA.size(),
+                     [&](size_t addrB, std::span<const Cell> inB) {
+                       f(addrB, inA.subspan(addrB - addrA, inB.size()), inB);
+                     });
+  });
+}
+
+template <class CPU>
+[[nodiscard]] auto ramEqual(const CPU &a, const CPU &b) -> bool {
+  bool equal = true;
+  forEachRAMSpanPair(a, b, 0, CPU::RAM::nCells,
+                     [&](size_t /*addr*/, auto cellsA, auto cellsB) {
+                       equal = equal && cellsEqual(cellsA, cellsB);
+                     });
+  return equal;
+}
+
+// registers, PC, SP and RAM
+template <class CPU>
+[[nodiscard]] auto statesEqual(const CPU &a, const CPU &b) -> bool {
+  return a.getPC() == b.getPC() && a.getSP() == b.getSP() &&
+         std::ranges::equal(a.regs_range(), b.regs_range()) && ramEqual(a, b);
+}
+
+template <class CPU>
+[[nodiscard]] auto firstRAMDifference(const CPU &a, const CPU &b)
+    -> std::optional<typename CPU::Addr> {
+  std::optional<typename CPU::Addr> found{};
+  forEachRAMSpanPair(a, b, 0, CPU::RAM::nCells,
+                     [&](size_t addr, auto cellsA, auto cellsB) {
+                       if (found) {
+                         return;
+                       }
+                       const size_t i = firstDifference(cellsA, cellsB);
+                       if (i < cellsA.size()) {
+                         found = static_cast<typename CPU::Addr>(addr + i);
+                       }
+                     });
+  return found;
+}
+
+template <class CPU>
+[[nodiscard]] auto diffRAM(const CPU &a, const CPU &b)
+    -> std::vector<DiffRange> {
+  std::vector<DiffRange> ranges{};
+  forEachRAMSpanPair(a, b, 0, CPU::RAM::nCells,
+                     [&](size_t addr, auto cellsA, auto cellsB) {
+                       diffCells(cellsA, cellsB, addr, ranges);
+                     });
+  return ranges;
+}
+
+// Same as diffRAM() looking at the pages dirty in a only, for a state run
+// from image with the dirty pages cleared at that point.
+template <class CPU>
+[[nodiscard]] auto diffDirtyRAM(const CPU &a, const CPU &image)
+    -> std::vector<DiffRange> {
+  constexpr size_t pageSize =
+      std::min(CPU::RAMController::pageSize, CPU::RAM::nCells);
+  std::vector<DiffRange> ranges{};
+  a.forEachDirtyPage([&](typename CPU::Addr first) {
+    forEachRAMSpanPair(a, image, first, pageSize,
+                       [&](size_t addr, auto cellsA, auto cellsB) {
+                         diffCells(cellsA, cellsB, addr, ranges);
+                       });
+  });
+  return ranges;
+}
+
+} // namespace shisa::fsim
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+
+// Compact dumps of a CPU state. A StateDump holds the registers, PC, SP and
+// the RAM as runs of cells, either the non-zero ones or the dirty pages.
+// It is written in a binary format or as text built in a buffer with a
+// hand-rolled hex formatter, both in a few large writes. The binary dump
+// does not depend on the CPU template parameters, so tools/dump2text
+// converts any of them to text offline.
+//
+// Binary format, integers little-endian:
+//   "ShISAdmp", u8 version, u8 register, address and cell bytes, u16 number
+//   of registers, the registers, PC, SP and the binary end, u64 number of
+//   runs, then per run its address, u64 number of cells and the cells.
+
+
+
+namespace shisa::fsim {
+
+struct StateDump {
+  static constexpr std::string_view magic   = "ShISAdmp";
+  static constexpr uint8_t          version = 1;
+
+  struct Run {
+    uint64_t              addr;
+    std::vector<uint64_t> cells;
+
+    auto operator==(const Run &) const -> bool = default;
+  };
+
+  uint8_t regBytes  = 0;
+  uint8_t addrBytes = 0;
+  uint8_t cellBytes = 0;
+
+  std::vector<uint64_t> regs{};
+  uint64_t              PC     = 0;
+  uint64_t              SP     = 0;
+  uint64_t              binEnd = 0;
+  std::vector<Run>      runs{};
+
+  auto operator==(const StateDump &) const -> bool = default;
+};
+
+// which RAM cells a dump holds
+enum class DumpCells {
+  nonZero, // runs of non-zero cells, split at zeroGap or more zeros
+  dirty,   // the pages dirty since the last CPU::clearDirtyPages()
+};
+
+namespace dump_detail {
+
+// zero cells kept inside a run rather than splitting it
+constexpr size_t zeroGap = 8;
+
+inline void putLE(std::string &buf, uint64_t value, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) {
+    buf.push_back(static_cast<char>(value >> (i * 8)));
+  }
+}
+
+inline auto fromLE(const unsigned char *raw, size_t bytes) -> uint64_t {
+  uint64_t value = 0;
+  for (size_t i = 0; i < bytes; i++) {
+    value |= static_cast<uint64_t>(raw[i]) << (i * 8);
+  }
+  return value;
+}
+
+// the dump in a stream
+class StreamReader {
+  std::istream &is;
+
+public:
+  explicit StreamReader(std::istream &in) : is{in} {}
+
+  void read(void *to, size_t bytes) {
+    is.read(static_cast<char *>(to), static_cast<std::streamsize>(bytes));
+    SHISA_CHECK(is.gcount() == static_cast<std::streamsize>(bytes),
+                "state dump is truncated");
+  }
+
+  auto getLE(size_t bytes) -> uint64_t {
+    std::array<unsigned char, sizeof(uint64_t)> raw{};
+    read(raw.data(), bytes);
+    return fromLE(raw.data(), bytes);
+  }
+};
+
+// the dump in memory, e.g. a mapped file, read in place by take()
+class BytesReader {
+  std::span<const std::byte> bytes;
+
+public:
+  explicit BytesReader(std::span<const std::byte> in) : bytes{in} {}
+
+  auto take(size_t n) -> std::span<const std::byte> {
+    SHISA_CHECK(n <= bytes.size(), "state dump is truncated");
+    const auto taken = bytes.first(n);
+    bytes            = bytes.subspan(n);
+    return taken;
+  }
+
+  void read(void *to, size_t n) { std::memcpy(to, take(n).data(), n); }
+
+  auto getLE(size_t n) -> uint64_t {
+    return fromLE(reinterpret_cast<const unsigned char *>(take(n).data()), n);
+  }
+};
+
+// Reads a dump but its runs: onRun(addr, nCells, cellBytes, in) reads the
+// cells of each one from in, little-endian of cellBytes bytes each.
+template <class Reader, typename F>
+auto readDump(Reader &in, F onRun) -> StateDump {
+  std::string magic(StateDump::magic.size(), '\0');
+  in.read(magic.data(), magic.size());
+  SHISA_CHECK(magic == StateDump::magic, "not a state dump");
+  SHISA_CHECK(in.getLE(1) == StateDump::version,
+              "unsupported state dump version");
+
+  StateDump dump{};
+  dump.regBytes  = static_cast<uint8_t>(in.getLE(1));
+  dump.addrBytes = static_cast<uint8_t>(in.getLE(1));
+  dump.cellBytes = static_cast<uint8_t>(in.getLE(1));
+  for (const uint8_t bytes : {dump.regBytes, dump.addrBytes, dump.cellBytes}) {
+    SHISA_CHECK(bytes >= 1 && bytes <= sizeof(uint64_t),
+                "bad integer width in the state dump");
+  }
+  dump.regs.resize(in.getLE(2));
+  for (uint64_t &reg : dump.regs) {
+    reg = in.getLE(dump.regBytes);
+  }
+  dump.PC     = in.getLE(dump.addrBytes);
+  dump.SP     = in.getLE(dump.addrBytes);
+  dump.binEnd = in.getLE(dump.addrBytes);
+
+  const uint64_t nRuns = in.getLE(sizeof(uint64_t));
+  for (uint64_t i = 0; i < nRuns; i++) {
+    const uint64_t addr   = in.getLE(dump.addrBytes);
+    const uint64_t nCells = in.getLE(sizeof(uint64_t));
+    onRun(addr, nCells, dump.cellBytes, in);
+  }
+  return dump;
+}
+
+// digits hex digits of value
+inline void putHex(std::string &buf, uint64_t value, size_t digits) {
+  static constexpr std::string_view hexDigits = "0123456789abcdef";
+  for (size_t i = digits; i-- > 0;) {
+    buf.push_back(hexDigits[(value >> (i * 4)) & 0xf]);
+  }
+}
+
+template <typename Cell>
+void appendRuns(std::vector<StateDump::Run> &runs, size_t base,
+                std::span<const Cell> cells, bool withZeros) {
+  for (size_t i = 0; i < cells.size();) {
+    if (!withZeros && cells[i] == 0) {
+      i++;
+      continue;
+    }
+    // a run goes on over fewer than zeroGap zeros, the runs of the dirty
+    // pages only when they are adjacent
+    StateDump::Run *run = nullptr;
+    if (!runs.empty() &&
+        (withZeros ? runs.back().addr + runs.back().cells.size() >= base + i
+                   : runs.back().addr + runs.back().cells.size() + zeroGap >
+                         base + i)) {
+      run = &runs.back();
+      // the zeros between the last run and this cell
+      run->cells.resize(base + i - run->addr, 0);
+    } else {
+      run = &runs.emplace_back(StateDump::Run{base + i, {}});
+    }
+    size_t zeros = 0;
+    for (; i < cells.size() && (withZeros || zeros < zeroGap); i++) {
+      zeros = cells[i] == 0 ? zeros + 1 : 0;
+      run->cells.push_back(cells[i]);
+    }
+    // the trailing zeros are not part of the run
+    run->cells.resize(run->cells.size() - (withZeros ? 0 : zeros));
+  }
+}
+
+} // namespace dump_detail
+
+template <class CPU>
+[[nodiscard]] auto makeStateDump(const CPU &cpu,
+                                 DumpCells which = DumpCells::nonZero)
+    -> StateDump {
+  using Cell = typename CPU::Cell;
+
+  StateDump dump{};
+  dump.regBytes  = sizeof(typename CPU::Reg);
+  dump.addrBytes = sizeof(typename CPU::Addr);
+  dump.cellBytes = sizeof(Cell);
+  for (size_t r = 0; r < CPU::NREGS; r++) {
+    dump.regs.push_back(cpu.readReg(static_cast<int>(r)));
+  }
+  dump.PC     = cpu.getPC();
+  dump.SP     = cpu.getSP();
+  dump.binEnd = cpu.getBinEnd();
+
+  const auto add = [&](size_t addr, std::span<const Cell> cells) {
+    dump_detail::appendRuns(dump.runs, addr, cells,
+                            which == DumpCells::dirty);
+  };
+  if (which == DumpCells::nonZero) {
+    cpu.forEachRAMSpan(0, CPU::RAM::nCells, add);
+  } else {
+    const size_t pageSize =
+        std::min(CPU::RAMController::pageSize, CPU::RAM::nCells);
+    cpu.forEachDirtyPage(
+        [&](typename CPU::Addr first) {
+          cpu.forEachRAMSpan(first, pageSize, add);
+        });
+  }
+  return dump;
+}
+
+// the bytes writeBinary() writes
+[[nodiscard]] inline auto encodeBinary(const StateDump &dump) -> std::string {
+  using dump_detail::putLE;
+
+  std::string buf{StateDump::magic};
+  putLE(buf, StateDump::version, 1);
+  putLE(buf, dump.regBytes, 1);
+  putLE(buf, dump.addrBytes, 1);
+  putLE(buf, dump.cellBytes, 1);
+  putLE(buf, dump.regs.size(), 2);
+  for (const uint64_t reg : dump.regs) {
+    putLE(buf, reg, dump.regBytes);
+  }
+  putLE(buf, dump.PC, dump.addrBytes);
+  putLE(buf, dump.SP, dump.addrBytes);
+  putLE(buf, dump.binEnd, dump.addrBytes);
+  putLE(buf, dump.runs.size(), sizeof(uint64_t));
+  for (const auto &run : dump.runs) {
+    putLE(buf, run.addr, dump.addrBytes);
+    putLE(buf, run.cells.size(), sizeof(uint64_t));
+    for (const uint64_t cell : run.cells) {
+      putLE(buf, cell, dump.cellBytes);
+    }
+  }
+  return buf;
+}
+
+inline void writeBinary(std::ostream &os, const StateDump &dump) {
+  const std::string buf = encodeBinary(dump);
+  os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+[[nodiscard]] inline auto readBinary(std::istream &is) -> StateDump {
+  dump_detail::StreamReader   in{is};
+  std::vector<StateDump::Run> runs{};
+
+  const auto readRun = [&runs](uint64_t addr, uint64_t nCells,
+                               size_t cellBytes, auto &cells) {
+    auto &run = runs.emplace_back();
+    run.addr  = addr;
+    // the cells are read one by one, a bad count fails on the stream end
+    for (uint64_t c = 0; c < nCells; c++) {
+      run.cells.push_back(cells.getLE(cellBytes));
+    }
+  };
+  StateDump dump = dump_detail::readDump(in, readRun);
+  dump.runs      = std::move(runs);
+  return dump;
+}
+
+// registers, PC and SP, then the runs as lines of up to 16 cells
+inline void writeText(std::ostream &os, const StateDump &dump) {
+  using dump_detail::putHex;
+
+  constexpr size_t lineCells = 16;
+  const size_t     regDigits  = 2 * static_cast<size_t>(dump.regBytes);
+  const size_t     addrDigits = 2 * static_cast<size_t>(dump.addrBytes);
+  const size_t     cellDigits = 2 * static_cast<size_t>(dump.cellBytes);
+
+  std::string buf{};
+  for (size_t r = 0; r < dump.regs.size(); r++) {
+    buf += 'r';
+    buf += std::to_string(r);
+    buf += r < 10 ? "  = 0x" : " = 0x";
+    putHex(buf, dump.regs[r], regDigits);
+    buf += '\n';
+  }
+  for (const auto &[name, value] :
+       {std::pair{"PC", dump.PC}, std::pair{"SP", dump.SP},
+        std::pair{"binEnd", dump.binEnd}}) {
+    buf += name;
+    buf += " = 0x";
+    putHex(buf, value, addrDigits);
+    buf += '\n';
+  }
+
+  for (const auto &run : dump.runs) {
+    for (size_t i = 0; i < run.cells.size(); i += lineCells) {
+      buf += "0x";
+      putHex(buf, run.addr + i, addrDigits);
+      buf += ':';
+      const size_t end = std::min(i + lineCells, run.cells.size());
+      for (size_t c = i; c < end; c++) {
+        buf += ' ';
+        putHex(buf, run.cells[c], cellDigits);
+      }
+      buf += '\n';
+    }
+  }
+  os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+} // namespace shisa::fsim
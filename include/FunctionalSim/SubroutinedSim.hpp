@@ -7,20 +7,24 @@
 
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <utility>
 
 
 
 namespace shisa::fsim {
 
 template <typename reg_t = uint16_t, typename addr_t = uint16_t,
-          typename cell_t = uint8_t, size_t nRegs = NREGS>
-class SubroutinedSim final : public SimBase<reg_t, addr_t, cell_t, nRegs> {
+          typename cell_t = uint8_t, size_t nRegs = NREGS,
+          class ram_t = RAMBase<addr_t, cell_t>>
+class SubroutinedSim final
+    : public SimBase<reg_t, addr_t, cell_t, nRegs, ram_t> {
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
 
-  using Sim = SimBase<Reg, Addr, Cell, nRegs>;
+  using Sim = SimBase<Reg, Addr, Cell, nRegs, ram_t>;
 
   USING_SIM_BASE(Sim);
 
@@ -51,7 +55,17 @@ private:
       };
 
 public:
-  SubroutinedSim(const Binary &b) : Sim{b} {}
+  SubroutinedSim(BinaryView b) : Sim{b} {}
+
+  explicit SubroutinedSim(std::shared_ptr<const typename Sim::Program> p)
+      : Sim{std::move(p)} {}
+
+  // a new sim in the state of this one, see SimBase::forkFrom()
+  [[nodiscard]] auto fork() -> std::unique_ptr<SubroutinedSim> {
+    auto child = std::make_unique<SubroutinedSim>(Sim::shareProgram());
+    child->forkFrom(*this);
+    return child;
+  }
 
   void executeOne() override {
     const shisa::Inst inst = fetchNext();
@@ -64,6 +78,7 @@ public:
 template <class S>
 concept isSubroutinedSim =
     std::is_same_v<S, SubroutinedSim<typename S::Reg, typename S::Addr,
-                                     typename S::Cell, shisa::NREGS>>;
+                                     typename S::Cell, shisa::NREGS,
+                                     typename S::RAM>>;
 
 } // namespace shisa::fsim
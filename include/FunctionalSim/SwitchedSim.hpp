@@ -6,24 +6,38 @@
 #include <exceptions.hpp>
 
 #include <cstdint>
+#include <memory>
+#include <utility>
 
 
 
 namespace shisa::fsim {
 
 template <typename reg_t = uint16_t, typename addr_t = uint16_t,
-          typename cell_t = uint8_t, size_t nRegs = NREGS>
-class SwitchedSim final : public SimBase<reg_t, addr_t, cell_t, nRegs> {
+          typename cell_t = uint8_t, size_t nRegs = NREGS,
+          class ram_t = RAMBase<addr_t, cell_t>>
+class SwitchedSim final
+    : public SimBase<reg_t, addr_t, cell_t, nRegs, ram_t> {
 public:
   using Reg  = reg_t;
   using Addr = addr_t;
   using Cell = cell_t;
 
-  using Sim = SimBase<Reg, Addr, Cell, nRegs>;
+  using Sim = SimBase<Reg, Addr, Cell, nRegs, ram_t>;
 
   USING_SIM_BASE(Sim);
 
-  SwitchedSim(const Binary &b) : Sim{b} {}
+  SwitchedSim(BinaryView b) : Sim{b} {}
+
+  explicit SwitchedSim(std::shared_ptr<const typename Sim::Program> p)
+      : Sim{std::move(p)} {}
+
+  // a new sim in the state of this one, see SimBase::forkFrom()
+  [[nodiscard]] auto fork() -> std::unique_ptr<SwitchedSim> {
+    auto child = std::make_unique<SwitchedSim>(Sim::shareProgram());
+    child->forkFrom(*this);
+    return child;
+  }
 
   void executeOne() override {
     const shisa::Inst inst = fetchNext();
@@ -88,6 +102,7 @@ public:
 template <class S>
 concept isSwitchedSim =
     std::is_same_v<S, SwitchedSim<typename S::Reg, typename S::Addr,
-                                  typename S::Cell, shisa::NREGS>>;
+                                  typename S::Cell, shisa::NREGS,
+                                  typename S::RAM>>;
 
 } // namespace shisa::fsim
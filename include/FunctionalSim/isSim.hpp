@@ -2,6 +2,7 @@
 
 #include "Sim.hpp"
 
+#include "HoistedSim.hpp"
 #include "PredecodedSim.hpp"
 #include "PredecodedSubroutinedSim.hpp"
 #include "SubroutinedSim.hpp"
@@ -13,7 +14,8 @@ namespace shisa::fsim {
 
 template <class S>
 concept isSim = std::derived_from<S, SimBase<typename S::Reg, typename S::Addr,
-                                             typename S::Cell, shisa::NREGS>>;
+                                             typename S::Cell, shisa::NREGS,
+                                             typename S::RAM>>;
 
 template <isSim Sim>
 static auto getSimName() -> std::string {
@@ -29,6 +31,9 @@ static auto getSimName() -> std::string {
   if (shisa::fsim::isPredecodedSubroutinedSim<Sim>) {
     return std::move(std::string{"PredecodedSubroutinedSim"});
   }
+  if (shisa::fsim::isHoistedSim<Sim>) {
+    return std::move(std::string{"HoistedSim"});
+  }
   return std::move(std::string{"UnknownSim"});
 }
 
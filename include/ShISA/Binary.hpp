@@ -3,6 +3,9 @@
 #include <ShISA/ISAModule.hpp>
 #include <ShISA/Inst.hpp>
 
+#include <cstddef>
+#include <span>
+#include <utility>
 #include <vector>
 
 
@@ -24,7 +27,7 @@ private:
 
 public:
   BinaryBase(ISAModule &&otherModule, BinaryData &&otherBData)
-      : M{otherModule}, binData{otherBData} {}
+      : M{std::move(otherModule)}, binData{std::move(otherBData)} {}
 
   [[nodiscard]] auto getISAModule() const -> const ISAModule & { return M; }
 
@@ -37,6 +40,39 @@ public:
   [[nodiscard]] auto nData() const -> size_t { return binData.size(); }
 };
 
-using Binary = BinaryBase<Inst, uint16_t>;
+// A binary over instructions and data owned elsewhere, e.g. by a Binary, an
+// assembler or a mapped file. Cheap to copy, valid while they are.
+template <typename inst_t, typename data_t>
+class BinaryViewBase {
+public:
+  using Data = data_t;
+  using Inst = inst_t;
+
+private:
+  std::span<const Inst> insts;
+  std::span<const Data> binData;
+
+public:
+  BinaryViewBase(std::span<const Inst> i, std::span<const Data> d)
+      : insts{i}, binData{d} {}
+
+  BinaryViewBase(const BinaryBase<Inst, Data> &b)
+      : insts{b.getISAModule().getInsts()}, binData{b.getRawData()} {}
+
+  [[nodiscard]] auto getInsts() const -> std::span<const Inst> {
+    return insts;
+  }
+
+  [[nodiscard]] auto getRawData() const -> std::span<const Data> {
+    return binData;
+  }
+
+  [[nodiscard]] auto nInsts() const -> size_t { return insts.size(); }
+
+  [[nodiscard]] auto nData() const -> size_t { return binData.size(); }
+};
+
+using Binary     = BinaryBase<Inst, uint16_t>;
+using BinaryView = BinaryViewBase<Inst, uint16_t>;
 
 } // namespace shisa
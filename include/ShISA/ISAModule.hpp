@@ -2,7 +2,9 @@
 
 #include "Inst.hpp"
 
+#include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 
@@ -20,7 +22,7 @@ public:
 
   ISAModuleBase(const std::vector<inst_t> &i) : insts{i} {}
 
-  ISAModuleBase(std::vector<inst_t> &&i) : insts{i} {}
+  ISAModuleBase(std::vector<inst_t> &&i) : insts{std::move(i)} {}
 
   [[nodiscard]] auto getInsts() const -> const std::vector<inst_t> & {
     return insts;
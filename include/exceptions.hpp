@@ -78,6 +78,13 @@ public:
 
 
 
+class StopRequested : public Exception {
+public:
+  StopRequested() : Exception{"stop requested"} {}
+};
+
+
+
 class StackOverflow : public Exception {
 public:
   StackOverflow() : Exception{"stack overflow"} {}
@@ -92,6 +99,31 @@ public:
 
 
 
+template <typename Addr, typename Data>
+class Watchpoint : public Exception {
+private:
+  Addr addr;
+  Data oldData;
+  Data newData;
+
+public:
+  Watchpoint(Addr a, Data oldD, Data newD)
+      : Exception{"watchpoint hit at address "}, addr{a}, oldData{oldD},
+        newData{newD} {
+    appendMsg(std::to_string(addr));
+    appendMsg(": ");
+    appendMsg(std::to_string(oldData));
+    appendMsg(" -> ");
+    appendMsg(std::to_string(newData));
+  }
+
+  [[nodiscard]] auto address() const noexcept -> Addr { return addr; }
+  [[nodiscard]] auto oldValue() const noexcept -> Data { return oldData; }
+  [[nodiscard]] auto newValue() const noexcept -> Data { return newData; }
+};
+
+
+
 template <typename T>
 concept IsInst = std::derived_from<T, Inst>;
 
@@ -56,7 +56,7 @@ namespace translator {
             return operations;
         }
 
-        auto getInstructionUint16() {
+        const std::vector<uint16_t>& getInstructionUint16() {
             if(operations.empty()) {
                 std::cerr << "COMMON_ERROR: Using getInstructionUint16 method before parsing\n";
             }
@@ -2,9 +2,12 @@
 #include <ShISA/Inst.hpp>
 #include <exceptions.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 #include <ranges>
 #include <type_traits>
+#include <vector>
 
 
 
@@ -635,6 +638,156 @@ void testRAM() { // {{{
 } // }}}
 
 
+void testRegsSpill() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  CPU          cpu;
+  const Binary bin = getTestBin();
+  cpu.loadBin(bin);
+
+  const Addr stackBegin = cpu.getSP();
+  const Addr stackEnd   = stackBegin + shisa::STACK_OFFSET;
+
+  auto regValue = [](int r) -> Reg { return 0x0100 * r + r; };
+  for (auto r : std::views::iota(shisa::FIRST_WRITABLE_REG, shisa::NREGS)) {
+    cpu.writeReg(r, regValue(r));
+  }
+
+  // a watched frame is stored word by word and reports the hit
+  constexpr int watchedReg  = 5;
+  const Addr    watchedWord = stackBegin + (watchedReg - 2) * CPU::cellsPerReg;
+  cpu.addWatchpoint(watchedWord + 1);
+  cpu.storeRegsOnStack();
+  try {
+    cpu.checkWatchpoints();
+    SHISA_CHECK_TEST(false, std::string{test_name} +
+                                ": store to a watched frame wasn't reported");
+  } catch (const shisa::Watchpoint<Addr, Reg> &e) {
+    SHISA_CHECK_TEST(e.address() == watchedWord &&
+                         e.newValue() == regValue(watchedReg),
+                     std::string{test_name} + ": wrong watchpoint hit: " +
+                         e.what());
+  }
+  cpu.clearWatchpoints();
+
+  for (auto r : std::views::iota(shisa::FIRST_WRITABLE_REG, shisa::NREGS)) {
+    cpu.writeReg(r, 0);
+  }
+  cpu.loadRegsFromStack();
+  for (auto r : std::views::iota(shisa::FIRST_WRITABLE_REG, shisa::NREGS)) {
+    SHISA_CHECK_TEST(cpu.readReg(r) == regValue(r),
+                     std::string{test_name} + ": r" + std::to_string(r) +
+                         " == " + std::to_string(cpu.readReg(r)) +
+                         " after the frame was loaded back");
+  }
+
+  // the bulk store marks all the pages the frame covers
+  constexpr Addr pageSize = CPU::RAMController::pageSize;
+  cpu.clearDirtyPages();
+  cpu.setSP(pageSize - 3);
+  cpu.storeRegsOnStack();
+  SHISA_CHECK_TEST(cpu.isPageDirty(0x0000) && cpu.isPageDirty(pageSize) &&
+                       !cpu.isPageDirty(2 * pageSize),
+                   std::string{test_name} +
+                       ": dirty pages differ after a frame store");
+
+  // a frame that doesn't fit overflows at the same register as before
+  cpu.setSP(stackEnd - 3 * CPU::cellsPerReg);
+  try {
+    cpu.storeRegsOnStack();
+    SHISA_CHECK_TEST(false, std::string{test_name} +
+                                ": frame was stored past the stack end");
+  } catch (const shisa::StackOverflow &e) {
+    SHISA_CHECK_TEST(cpu.getSP() == stackEnd &&
+                         cpu.readWordFromRAM(stackEnd) == regValue(5),
+                     std::string{test_name} + ": SP == " +
+                         std::to_string(cpu.getSP()) +
+                         " after stack overflow in the middle of a frame");
+  }
+
+  // and a frame that doesn't fit underflows at the same register as before
+  cpu.setSP(stackBegin + 3 * CPU::cellsPerReg);
+  try {
+    cpu.loadRegsFromStack();
+    SHISA_CHECK_TEST(false, std::string{test_name} +
+                                ": frame was loaded from below the stack");
+  } catch (const shisa::StackUnderflow &e) {
+    SHISA_CHECK_TEST(cpu.getSP() == stackBegin &&
+                         cpu.readReg(13) == cpu.readWordFromRAM(stackBegin),
+                     std::string{test_name} + ": SP == " +
+                         std::to_string(cpu.getSP()) +
+                         " after stack underflow in the middle of a frame");
+  }
+} // }}}
+
+
+void testCopy() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  CPU          cpu;
+  const Binary bin = getTestBin();
+  cpu.loadBin(bin);
+  const Addr binEnd = cpu.getBinEnd();
+
+  std::vector<Cell> in(0x0800);
+  std::iota(in.begin(), in.end(), Cell{1});
+  std::vector<Cell> out(in.size());
+
+  // a single bulk copy each way
+  cpu.copyIn(0x2000, in);
+  cpu.copyOut(0x2000, out);
+  SHISA_CHECK_TEST(in == out && cpu.readFromRAM(0x2000 + 0x07ff) == in.back(),
+                   std::string{test_name} + ": copied cells differ");
+  const std::span<const Cell> view = cpu.viewRAM(0x2000, in.size());
+  SHISA_CHECK_TEST(std::ranges::equal(view, in),
+                   std::string{test_name} + ": RAM view differs");
+
+  // over the binary end, the binary cells are kept
+  const Cell lastBinCell = cpu.readFromRAM(binEnd - 1);
+  cpu.copyIn(binEnd - 1, std::span{in}.first(4));
+  SHISA_CHECK_TEST(cpu.readFromRAM(binEnd - 1) == lastBinCell &&
+                       cpu.readFromRAM(binEnd) == in[1] &&
+                       cpu.readFromRAM(binEnd + 2) == in[3],
+                   std::string{test_name} + ": copy over the binary end");
+
+  // wrapping around the address space
+  cpu.copyIn(0xfffe, std::span{in}.first(4));
+  cpu.copyOut(0xfffe, std::span{out}.first(4));
+  SHISA_CHECK_TEST(cpu.readFromRAM(0xffff) == in[1] && out[0] == in[0] &&
+                       out[1] == in[1] && out[2] == cpu.readFromRAM(0x0000),
+                   std::string{test_name} + ": copy around the address end");
+  try {
+    (void)cpu.viewRAM(0xfffe, 4);
+    SHISA_CHECK_TEST(false, std::string{test_name} +
+                                ": RAM view wraps around the address end");
+  } catch (const shisa::Exception &e) {
+  }
+
+  // big-endian words
+  const std::vector<Reg> words = {0x1234, 0x5678, 0x9abc};
+  std::vector<Reg>       wordsOut(words.size());
+  cpu.copyWordsIn(0x3001, words);
+  cpu.copyWordsOut(0x3001, wordsOut);
+  SHISA_CHECK_TEST(words == wordsOut && cpu.readFromRAM(0x3001) == 0x12 &&
+                       cpu.readWordFromRAM(0x3003) == 0x5678,
+                   std::string{test_name} + ": copied words differ");
+
+  // a watched cell is reported as for the single stores
+  cpu.addWatchpoint(0x4010);
+  cpu.copyIn(0x4000, std::span{in}.first(0x20));
+  try {
+    cpu.checkWatchpoints();
+    SHISA_CHECK_TEST(false, std::string{test_name} +
+                                ": copy to a watched cell wasn't reported");
+  } catch (const shisa::Watchpoint<Addr, Reg> &e) {
+    SHISA_CHECK_TEST(e.address() == 0x4010 && e.newValue() == in[0x10],
+                     std::string{test_name} + ": wrong watchpoint hit: " +
+                         e.what());
+  }
+  cpu.clearWatchpoints();
+} // }}}
+
+
 
 int main() {
   try {
@@ -643,6 +796,8 @@ int main() {
     testSP();
     testRF();
     testRAM();
+    testRegsSpill();
+    testCopy();
   } catch (const shisa::test::Exception &e) {
     std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
     exit(EXIT_FAILURE);
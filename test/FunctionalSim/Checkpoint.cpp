@@ -0,0 +1,234 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/Checkpoint.hpp>
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using RAM = shisa::fsim::PagedRAM<Addr, Cell>;
+
+using shisa::Binary;
+using shisa::ISAModule;
+using shisa::OpCode;
+using shisa::test::resultAddr;
+using shisa::test::sameState;
+
+
+
+static auto getTestBin(OpCode op = OpCode::ADD) -> Binary {
+  return shisa::test::getStorePushBin(op);
+}
+
+static auto tempPath(const std::string &name) -> std::string {
+  return shisa::test::tempPath(name, ".ckp");
+}
+
+// runs sim up to the store to resultAddr
+template <class Sim>
+void runToStore(Sim &sim) {
+  sim.addWatchpoint(resultAddr, 2);
+  try {
+    sim.executeAll();
+  } catch (const shisa::Exception &) {
+  }
+  sim.clearWatchpoints();
+}
+
+template <class Sim>
+void testRestore(const std::string &test_name) { // {{{
+  const Binary      bin  = getTestBin();
+  const std::string path = tempPath("restore");
+
+  Sim sim{bin};
+  runToStore(sim);
+  SHISA_CHECK_TEST(sim.retiredInsts() > 0 &&
+                       sim.getState().readWordFromRAM(resultAddr) == 0x0007,
+                   test_name + ": watchpoint not hit");
+  shisa::fsim::saveCheckpoint(path, sim);
+
+  Sim restored{bin};
+  shisa::fsim::restoreCheckpoint(path, restored);
+  std::filesystem::remove(path);
+  SHISA_CHECK_TEST(sameState(restored, sim),
+                   test_name + ": restored state differs");
+
+  // both run on to the same end
+  sim.executeAll();
+  restored.executeAll();
+  SHISA_CHECK_TEST(sameState(restored, sim),
+                   test_name + ": restored sim ends in another state");
+} // }}}
+
+template <class Sim>
+void testRestoreRun(const std::string &test_name) { // {{{
+  const Binary      bin  = getTestBin();
+  const std::string path = tempPath("restore-run");
+
+  Sim sim{bin};
+  runToStore(sim);
+  shisa::fsim::saveCheckpoint(path, sim);
+
+  // the target has run past the checkpoint, so its RAM, registers and
+  // retired count all differ and it has an event pending
+  Sim target{bin};
+  target.scheduleEvent(5000, 0x0012);
+  target.executeAll();
+  SHISA_CHECK_TEST(!sameState(target, sim),
+                   test_name + ": target not ahead of the checkpoint");
+  shisa::fsim::restoreCheckpoint(path, target);
+  std::filesystem::remove(path);
+  SHISA_CHECK_TEST(sameState(target, sim) && target.pendingEvents().empty(),
+                   test_name + ": restored state differs");
+
+  sim.executeAll();
+  target.executeAll();
+  SHISA_CHECK_TEST(sameState(target, sim),
+                   test_name + ": restored sim ends in another state");
+} // }}}
+
+template <class Sim>
+void testEvents(const std::string &test_name) { // {{{
+  const Binary      bin  = getTestBin();
+  const std::string path = tempPath("events");
+
+  // due after the end of the program, so they stay pending
+  Sim sim{bin};
+  sim.scheduleEvent(2000, 0x0010, 100);
+  sim.scheduleEvent(1000, 0x0011);
+  runToStore(sim);
+  shisa::fsim::saveCheckpoint(path, sim);
+
+  Sim restored{bin};
+  restored.scheduleEvent(500, 0x0012);
+  shisa::fsim::restoreCheckpoint(path, restored);
+  std::filesystem::remove(path);
+
+  const auto events         = sim.pendingEvents();
+  const auto restoredEvents = restored.pendingEvents();
+  SHISA_CHECK_TEST(std::ranges::equal(
+                       events, restoredEvents,
+                       [](const auto &a, const auto &b) {
+                         return a.deadline == b.deadline &&
+                                a.entry == b.entry && a.period == b.period;
+                       }),
+                   test_name + ": restored events differ");
+} // }}}
+
+template <class Sim>
+void testBackground(const std::string &test_name) { // {{{
+  const Binary      bin  = getTestBin();
+  const std::string path = tempPath("background");
+
+  Sim sim{bin};
+  runToStore(sim);
+  const auto                         at = sim.fork();
+  shisa::fsim::CheckpointWriter<Sim> writer{};
+  writer.save(sim, path);
+  // the sim goes on while the checkpoint is written
+  sim.executeAll();
+  writer.wait();
+
+  Sim restored{bin};
+  shisa::fsim::restoreCheckpoint(path, restored);
+  std::filesystem::remove(path);
+  SHISA_CHECK_TEST(sameState(restored, *at),
+                   test_name + ": checkpoint is not of the state at save()");
+} // }}}
+
+template <class Sim>
+void testBadCheckpoint(const std::string &test_name) { // {{{
+  const std::string path = tempPath("bad");
+
+  Sim sim{getTestBin()};
+  runToStore(sim);
+  shisa::fsim::saveCheckpoint(path, sim);
+
+  const auto fails = [&](auto &&target) {
+    try {
+      shisa::fsim::restoreCheckpoint(path, target);
+    } catch (const shisa::Exception &) {
+      return true;
+    }
+    return false;
+  };
+
+  SHISA_CHECK_TEST(!fails(Sim{getTestBin()}),
+                   test_name + ": good checkpoint rejected");
+  SHISA_CHECK_TEST(fails(Sim{getTestBin(OpCode::SUB)}),
+                   test_name + ": checkpoint of another program accepted");
+
+  // a checkpoint of a program of another size is rejected before the
+  // target is written
+  const Binary longer{ISAModule{getTestBin().getISAModule()},
+                      {0x0007, resultAddr, 0x0000}};
+  Sim          target{longer};
+  SHISA_CHECK_TEST(fails(target),
+                   test_name + ": checkpoint of another size accepted");
+  SHISA_CHECK_TEST(sameState(target, Sim{longer}),
+                   test_name + ": rejected checkpoint written");
+
+  std::vector<char> bytes{};
+  {
+    std::ifstream in{path, std::ios::binary};
+    bytes.assign(std::istreambuf_iterator<char>{in}, {});
+  }
+  bytes[0] = 'X';
+  std::ofstream{path, std::ios::binary | std::ios::trunc}.write(
+      bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  SHISA_CHECK_TEST(fails(Sim{getTestBin()}),
+                   test_name + ": bad magic accepted");
+
+  bytes.resize(30);
+  bytes[0] = 'S';
+  std::ofstream{path, std::ios::binary | std::ios::trunc}.write(
+      bytes.data(), static_cast<std::streamsize>(bytes.size()));
+  SHISA_CHECK_TEST(fails(Sim{getTestBin()}),
+                   test_name + ": truncated checkpoint accepted");
+  std::filesystem::remove(path);
+} // }}}
+
+
+
+int main() {
+  using Predecoded = shisa::fsim::PredecodedSim<>;
+  using Hoisted =
+      shisa::fsim::HoistedSim<Reg, Addr, Cell, shisa::NREGS, RAM>;
+
+  try {
+    testRestore<Predecoded>("testRestore<PredecodedSim>");
+    testRestore<Hoisted>("testRestore<HoistedSim, PagedRAM>");
+    testRestoreRun<Predecoded>("testRestoreRun<PredecodedSim>");
+    testRestoreRun<Hoisted>("testRestoreRun<HoistedSim, PagedRAM>");
+    testEvents<Predecoded>("testEvents<PredecodedSim>");
+    testEvents<Hoisted>("testEvents<HoistedSim, PagedRAM>");
+    testBackground<Predecoded>("testBackground<PredecodedSim>");
+    testBackground<Hoisted>("testBackground<HoistedSim, PagedRAM>");
+    testBadCheckpoint<Predecoded>("testBadCheckpoint<PredecodedSim>");
+    testBadCheckpoint<Hoisted>("testBadCheckpoint<HoistedSim, PagedRAM>");
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
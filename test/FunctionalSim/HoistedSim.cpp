@@ -0,0 +1,172 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using SimTester = shisa::test::SimTester<Reg, Addr, Cell, shisa::NREGS,
+                                         shisa::fsim::HoistedSim>;
+
+
+
+static void testJumpCache() {
+  constexpr auto test_name = __FUNCTION__;
+
+  using shisa::Inst;
+  using shisa::OpCode;
+
+  shisa::ISAModule M{{
+      Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1),
+      Inst::encode(OpCode::ADD, 0xf, 0x0, 0x0),
+      Inst::encode(OpCode::LD, 0x3, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0xe, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0xd, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0xc, 0xf, 0x0),
+      Inst::encode(OpCode::CALL, 0xd, 0x0, 0x0),
+      Inst::encode(OpCode::ADD, 0x4, 0x4, 0x1),
+      Inst::encode(OpCode::CMP, 0x5, 0x3, 0x4),
+      Inst::encode(OpCode::XOR, 0x5, 0x5, 0x1),
+      Inst::encode(OpCode::JTR, 0x0, 0x5, 0xe),
+      Inst::encode(OpCode::JTR, 0x0, 0x0, 0xc),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+  }};
+
+  // loop count, loop address, function address, end address
+  shisa::Binary::BinaryData data = {100, 0x001a, 0x0026, 0x0028};
+
+  const shisa::Binary       bin{std::move(M), std::move(data)};
+  shisa::fsim::HoistedSim<> sim{bin};
+  sim.executeAll();
+
+  const auto &stats = sim.getJumpCacheStats();
+  SHISA_CHECK_TEST(sim.getState().readReg(0x4) == 100,
+                   std::string{test_name} + ": wrong loop count");
+  // the first CALL, the first loop jump and the exit jump miss
+  SHISA_CHECK_TEST(stats.hits == 99 + 98 && stats.misses == 3,
+                   std::string{test_name} + ": " + std::to_string(stats.hits) +
+                       " hits and " + std::to_string(stats.misses) +
+                       " misses but must be 197 hits and 3 misses");
+}
+
+
+static void testReturnCache() {
+  constexpr auto test_name = __FUNCTION__;
+
+  using shisa::Inst;
+  using shisa::OpCode;
+
+  // the callee overwrites the saved r4 of its own frame
+  shisa::ISAModule M{{
+      Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1),
+      Inst::encode(OpCode::ADD, 0xf, 0x0, 0x0),
+      Inst::encode(OpCode::LD, 0x3, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x5, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x6, 0xf, 0x0),
+      Inst::encode(OpCode::CALL, 0x3, 0x0, 0x0),
+      Inst::encode(OpCode::JTR, 0x0, 0x0, 0x6),
+      Inst::encode(OpCode::ADD, 0x4, 0x2, 0x2),
+      Inst::encode(OpCode::ST, 0x0, 0x5, 0x2),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+  }};
+
+  // function address, saved r4 address, end address
+  shisa::Binary::BinaryData data = {0x0018, 0x0024, 0x001e};
+
+  const shisa::Binary       bin{std::move(M), std::move(data)};
+  shisa::fsim::HoistedSim<> sim{bin};
+  sim.executeAll();
+
+  const Reg r4 = sim.getState().readReg(0x4);
+  SHISA_CHECK_TEST(r4 == 2, std::string{test_name} + ": r4 == " +
+                                std::to_string(r4) + " but must be r4 == 2");
+}
+
+
+static void testLazyFrames() {
+  constexpr auto test_name = __FUNCTION__;
+
+  using shisa::Inst;
+  using shisa::OpCode;
+
+  // recursion that reads the bottom of the stack at its deepest call
+  shisa::ISAModule M{{
+      Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1),
+      Inst::encode(OpCode::ADD, 0xf, 0x0, 0x0),
+      Inst::encode(OpCode::LD, 0x3, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x4, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x6, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x7, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x9, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0xa, 0xf, 0x0),
+      Inst::encode(OpCode::CALL, 0x3, 0x0, 0x0),
+      Inst::encode(OpCode::JTR, 0x0, 0x0, 0x6),
+      Inst::encode(OpCode::CMP, 0x5, 0x4, 0x0),
+      Inst::encode(OpCode::JTR, 0x0, 0x5, 0x7),
+      Inst::encode(OpCode::SUB, 0x4, 0x4, 0x1),
+      Inst::encode(OpCode::CALL, 0x3, 0x0, 0x0),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+      Inst::encode(OpCode::LD, 0x8, 0x9, 0x0),
+      Inst::encode(OpCode::ST, 0x0, 0xa, 0x8),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+  }};
+
+  // function address, depth, end address, deepest call address, stack
+  // begin, result address
+  shisa::Binary::BinaryData data = {0x002a, 5, 0x003a, 0x0034, 0x003a, 0x2000};
+
+  const shisa::Binary          bin{std::move(M), std::move(data)};
+  shisa::fsim::HoistedSim<>    sim{bin};
+  shisa::fsim::PredecodedSim<> ref{bin};
+  sim.executeAll();
+  ref.executeAll();
+
+  const auto &state = sim.getState();
+  const Reg   ret   = state.readWordFromRAM(0x2000);
+  SHISA_CHECK_TEST(ret == 0x0028, std::string{test_name} +
+                                      ": return address read from the stack "
+                                      "== " +
+                                      std::to_string(ret) + " but must be 40");
+  SHISA_CHECK_TEST(
+      state.getSP() == ref.getState().getSP() &&
+          std::ranges::equal(state.regs_range(), ref.getState().regs_range()) &&
+          std::ranges::equal(state.ram_range(), ref.getState().ram_range()),
+      std::string{test_name} + ": state differs from PredecodedSim");
+}
+
+
+
+int main() {
+  try {
+    SimTester::runTests();
+    testJumpCache();
+    testReturnCache();
+    testLazyFrames();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
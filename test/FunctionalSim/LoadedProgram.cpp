@@ -0,0 +1,157 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/LoadedProgram.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <FunctionalSim/PredecodedSubroutinedSim.hpp>
+#include <FunctionalSim/SwitchedSim.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using Program = shisa::fsim::LoadedProgramBase<Addr, Cell>;
+using RAM     = shisa::fsim::PagedRAM<Addr, Cell>;
+
+using shisa::Binary;
+using shisa::OpCode;
+
+using shisa::test::getStorePushBin;
+using shisa::test::resultAddr;
+using shisa::test::sameState;
+
+
+
+void testProgram() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  const Binary bin     = getStorePushBin();
+  const auto   program = Program::load(bin);
+
+  const auto image = program->getImage();
+  SHISA_CHECK_TEST(program->getDataEnd() == 4 &&
+                       program->getBinEnd() == 4 + 2 * bin.nInsts() &&
+                       image.size() % (Program::imageAlignment / sizeof(Cell)) ==
+                           0,
+                   std::string{test_name} + ": wrong image layout");
+  SHISA_CHECK_TEST(image[0] == 0x00 && image[1] == 0x07 && image[2] == 0x20 &&
+                       image[3] == 0x00 &&
+                       std::all_of(image.begin() + program->getBinEnd(),
+                                   image.end(), [](Cell c) { return c == 0; }),
+                   std::string{test_name} + ": wrong image cells");
+  SHISA_CHECK_TEST(program->getDecoded().size() == bin.nInsts() &&
+                       program->getDecoded()[3].opCode == OpCode::ST,
+                   std::string{test_name} + ": wrong decoded instructions");
+
+  int  nBuilds = 0;
+  auto build   = [&](const Program &p) {
+    nBuilds++;
+    return p.getDecoded().size();
+  };
+  const auto first  = program->getTranslation<size_t>(build);
+  const auto second = program->getTranslation<size_t>(build);
+  SHISA_CHECK_TEST(nBuilds == 1 && first == second && *first == bin.nInsts(),
+                   std::string{test_name} + ": translation built " +
+                       std::to_string(nBuilds) + " times");
+} // }}}
+
+void testSharedImage() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  const auto program = Program::load(getStorePushBin());
+  const auto image   = program->getImage();
+
+  RAM ram{};
+  ram.shareImage(image, program);
+  SHISA_CHECK_TEST(ram.allocatedPages() == 0 &&
+                       std::equal(image.begin(), image.end(), ram.begin()),
+                   std::string{test_name} + ": image not mapped");
+
+  RAM copy{ram};
+  ram.write(program->getBinEnd(), 0xaa);
+  SHISA_CHECK_TEST(ram.allocatedPages() == 1 && ram.read(0) == 0x00 &&
+                       ram.read(1) == 0x07 &&
+                       ram.read(program->getBinEnd()) == 0xaa,
+                   std::string{test_name} + ": page not copied on write");
+  SHISA_CHECK_TEST(image[program->getBinEnd()] == 0 &&
+                       copy.read(program->getBinEnd()) == 0 &&
+                       copy.allocatedPages() == 0,
+                   std::string{test_name} + ": write reached the image");
+
+  // a partial last page is copied
+  RAM tail{};
+  tail.shareImage(image.first(RAM::pageCells + 2), program);
+  SHISA_CHECK_TEST(tail.allocatedPages() == 1 &&
+                       std::equal(image.begin(),
+                                  image.begin() + RAM::pageCells + 2,
+                                  tail.begin()),
+                   std::string{test_name} + ": partial page differs");
+} // }}}
+
+template <class Sim>
+void testSharedSims(const std::string &test_name) { // {{{
+  const Binary bin     = getStorePushBin();
+  const auto   program = Program::load(bin);
+
+  Sim ref{bin};
+  Sim first{program};
+  Sim second{program};
+  SHISA_CHECK_TEST(&first.getProgram() == program.get() &&
+                       &second.getProgram() == program.get(),
+                   test_name + ": program not shared");
+
+  ref.executeAll();
+  first.executeAll();
+  SHISA_CHECK_TEST(sameState(first, ref) &&
+                       first.getState().readWordFromRAM(resultAddr) == 0x0007,
+                   test_name + ": differs from a sim of the binary");
+
+  // the run of the first sim is not seen by the second one
+  SHISA_CHECK_TEST(second.getState().readWordFromRAM(resultAddr) == 0 &&
+                       second.getState().readWordFromRAM(
+                           second.getState().getBinEnd()) == 0,
+                   test_name + ": sims share written RAM");
+  second.executeAll();
+  SHISA_CHECK_TEST(std::ranges::equal(first.getState().ram_range(),
+                                      second.getState().ram_range()),
+                   test_name + ": sims of one program differ");
+} // }}}
+
+
+
+int main() {
+  try {
+    testProgram();
+    testSharedImage();
+    testSharedSims<shisa::fsim::SwitchedSim<>>("testSharedSims<SwitchedSim>");
+    testSharedSims<shisa::fsim::PredecodedSim<>>(
+        "testSharedSims<PredecodedSim>");
+    testSharedSims<shisa::fsim::PredecodedSubroutinedSim<>>(
+        "testSharedSims<PredecodedSubroutinedSim>");
+    testSharedSims<shisa::fsim::HoistedSim<>>("testSharedSims<HoistedSim>");
+    testSharedSims<shisa::fsim::HoistedSim<Reg, Addr, Cell, shisa::NREGS,
+                                           RAM>>(
+        "testSharedSims<HoistedSim, PagedRAM>");
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,228 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/CPU.hpp>
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/MappedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using RAM      = shisa::fsim::MappedRAM<Addr, Cell>;
+using CPU      = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS, RAM>;
+using CPUPlain = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS>;
+
+template <typename R, typename A, typename C, size_t N>
+using MappedPredecodedSim =
+    shisa::fsim::PredecodedSim<R, A, C, N, shisa::fsim::MappedRAM<A, C>>;
+template <typename R, typename A, typename C, size_t N>
+using MappedHoistedSim =
+    shisa::fsim::HoistedSim<R, A, C, N, shisa::fsim::MappedRAM<A, C>>;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+
+
+
+static auto getTestBin(size_t nInsts) -> Binary {
+  std::vector<Inst> insts(nInsts, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1,
+                                                    0x1)});
+  return Binary{ISAModule{insts}, {0xbeef, 0xdead}};
+}
+
+void testMappedRAM() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  RAM ram{};
+  SHISA_CHECK_TEST(std::ranges::all_of(ram, [](Cell c) { return c == 0; }),
+                   std::string{test_name} + ": RAM not initialised with zero");
+
+  ram.write(0x0000, 0x12);
+  ram.write(0xffff, 0x34);
+  SHISA_CHECK_TEST(ram.readWord<Reg>(0xffff) == 0x3412,
+                   std::string{test_name} +
+                       ": word at the last address doesn't wrap around");
+
+  // the cells are kept when the binary end moves them to another page
+  for (size_t addr = 0; addr < RAM::nCells; addr++) {
+    ram.write(static_cast<Addr>(addr), static_cast<Cell>(addr * 7));
+  }
+  constexpr Addr binEnd = 0x0123;
+  ram.placeBinary(binEnd);
+  for (size_t addr = 0; addr < RAM::nCells; addr++) {
+    SHISA_CHECK_TEST(ram.read(static_cast<Addr>(addr)) ==
+                         static_cast<Cell>(addr * 7),
+                     std::string{test_name} + ": cell at " +
+                         std::to_string(addr) + " lost on placing the binary");
+  }
+
+  const auto checkCell = [&](Addr addr, Cell expected, const char *what) {
+    SHISA_CHECK_TEST(ram.read(addr) == expected,
+                     std::string{test_name} + ": cell at " +
+                         std::to_string(addr) + " == " +
+                         std::to_string(ram.read(addr)) + " after " + what +
+                         " but must be " + std::to_string(expected));
+  };
+
+  ram.writeGuest(0x0100, 0xaa);
+  checkCell(0x0100, static_cast<Cell>(0x0100 * 7), "store to the binary");
+  ram.writeGuest(binEnd, 0xaa);
+  checkCell(binEnd, 0xaa, "store right after the binary");
+  // shares the host page with the start of the binary
+  ram.writeGuest(0xffff, 0xbb);
+  checkCell(0xffff, 0xbb, "store to the last address");
+
+  ram.writeWordGuest<Reg>(binEnd - 1, 0x1122);
+  checkCell(binEnd - 1, static_cast<Cell>((binEnd - 1) * 7),
+            "word store over the binary end");
+  checkCell(binEnd, 0x22, "word store over the binary end");
+  ram.writeWordGuest<Reg>(0xffff, 0x3344);
+  checkCell(0xffff, 0x33, "word store at the last address");
+  checkCell(0x0000, 0x00, "word store at the last address");
+
+  const auto checkStack = [&](Addr addr, bool expected) {
+    Reg        data    = 0;
+    const bool stored  = ram.storeStackWord<Reg>(addr, 0x5566);
+    const bool loaded  = ram.loadStackWord<Reg>(addr, data);
+    const bool matches = stored == expected && loaded == expected &&
+                         (!expected || data == 0x5566);
+    SHISA_CHECK_TEST(matches, std::string{test_name} + ": stack word at " +
+                                  std::to_string(addr) +
+                                  (expected ? " not accessed"
+                                            : " accessed out of the stack"));
+  };
+  checkStack(binEnd, true);
+  checkStack(binEnd + shisa::STACK_OFFSET - 2, true);
+  checkStack(binEnd - 1, false);
+  checkStack(binEnd + shisa::STACK_OFFSET - 1, false);
+  checkStack(0xffff, false);
+  checkCell(binEnd - 1, static_cast<Cell>((binEnd - 1) * 7),
+            "stack store under the stack");
+
+  const RAM copy{ram};
+  SHISA_CHECK_TEST(std::ranges::equal(copy, ram),
+                   std::string{test_name} + ": copy differs");
+} // }}}
+
+void testStack() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  // the result must match the plain RAM on both ends of the stack, also
+  // for the binary end on a host page boundary
+  for (const size_t nInsts : {3, 0x7fe}) {
+    const Binary bin = getTestBin(nInsts);
+    CPU          cpu{};
+    CPUPlain     ref{};
+    cpu.loadBin(bin);
+    ref.loadBin(bin);
+
+    auto same = [&](const char *what) {
+      SHISA_CHECK_TEST(cpu.getSP() == ref.getSP() &&
+                           std::ranges::equal(cpu.ram_range(),
+                                              ref.ram_range()),
+                       std::string{test_name} + ": state differs " + what);
+    };
+
+    auto push = [](auto &c) {
+      c.writeReg(0x5, 0xabcd);
+      try {
+        for (ever) {
+          c.storeRegOnStack(0x5);
+        }
+      } catch (const shisa::StackOverflow &e) {
+      }
+    };
+    push(cpu);
+    push(ref);
+    same("after overflow");
+
+    auto pop = [](auto &c) {
+      try {
+        for (ever) {
+          c.loadRegFromStack(0x6);
+        }
+      } catch (const shisa::StackUnderflow &e) {
+      }
+    };
+    pop(cpu);
+    pop(ref);
+    same("after underflow");
+    SHISA_CHECK_TEST(cpu.readReg(0x6) == 0xabcd,
+                     std::string{test_name} + ": popped r6 == " +
+                         std::to_string(cpu.readReg(0x6)));
+
+    // odd SP, the last word crosses the stack end
+    auto pushPC = [](auto &c) {
+      c.setSP(c.getBinEnd() + 1);
+      try {
+        for (ever) {
+          c.storePCOnStack();
+        }
+      } catch (const shisa::StackOverflow &e) {
+      }
+    };
+    pushPC(cpu);
+    pushPC(ref);
+    same("after overflow from odd SP");
+  }
+} // }}}
+
+void testDirtyPages() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  using Controller = shisa::fsim::RAMControllerBase<Addr, Cell, RAM>;
+
+  // the binary ends on a page boundary, 0x1000
+  Controller controller{};
+  controller.loadBin(getTestBin(0x7fe));
+  const Addr binEnd = controller.getBinEnd();
+  controller.clearDirtyPages();
+
+  // dropped stores into the binary dirty no page
+  controller.write(0x0100, 0xaa);
+  controller.writeWord<Reg>(0x0500, 0x1122);
+  controller.writeWord<Reg>(binEnd - 1, 0x3344);
+  std::vector<Addr> pages{};
+  controller.forEachDirtyPage([&](Addr first) { pages.push_back(first); });
+  SHISA_CHECK_TEST(pages == std::vector<Addr>{binEnd},
+                   std::string{test_name} + ": " +
+                       std::to_string(pages.size()) +
+                       " dirty pages but must be the one at the binary end");
+} // }}}
+
+
+
+int main() {
+  try {
+    testMappedRAM();
+    testStack();
+    testDirtyPages();
+    shisa::test::SimTester<Reg, Addr, Cell, shisa::NREGS,
+                           MappedPredecodedSim>::runTests();
+    shisa::test::SimTester<Reg, Addr, Cell, shisa::NREGS,
+                           MappedHoistedSim>::runTests();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,250 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/CPU.hpp>
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using RAM = shisa::fsim::PagedRAM<Addr, Cell>;
+
+template <typename R, typename A, typename C, size_t N>
+using PagedPredecodedSim =
+    shisa::fsim::PredecodedSim<R, A, C, N, shisa::fsim::PagedRAM<A, C>>;
+template <typename R, typename A, typename C, size_t N>
+using PagedHoistedSim =
+    shisa::fsim::HoistedSim<R, A, C, N, shisa::fsim::PagedRAM<A, C>>;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+
+
+
+void testPagedRAM() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  RAM ram{};
+  SHISA_CHECK_TEST(std::ranges::all_of(ram, [](Cell c) { return c == 0; }),
+                   std::string{test_name} + ": RAM not initialised with zero");
+  SHISA_CHECK_TEST(ram.allocatedPages() == 0,
+                   std::string{test_name} + ": pages allocated by reads");
+
+  const auto checkPages = [&](size_t expected, const char *what) {
+    SHISA_CHECK_TEST(ram.allocatedPages() == expected,
+                     std::string{test_name} + ": " +
+                         std::to_string(ram.allocatedPages()) +
+                         " pages allocated after " + what + " but must be " +
+                         std::to_string(expected));
+  };
+
+  ram.write(0x0000, 0x12);
+  ram.write(0xffff, 0x34);
+  checkPages(2, "writes to both ends");
+  SHISA_CHECK_TEST(ram.readWord<Reg>(0xffff) == 0x3412,
+                   std::string{test_name} +
+                       ": word at the last address doesn't wrap around");
+
+  // across the first page boundary, allocating the second page
+  ram.writeWord<Reg>(RAM::pageCells - 1, 0xabcd);
+  checkPages(3, "word store across pages");
+  SHISA_CHECK_TEST(ram.read(RAM::pageCells - 1) == 0xab &&
+                       ram.read(RAM::pageCells) == 0xcd &&
+                       ram.readWord<Reg>(RAM::pageCells - 1) == 0xabcd,
+                   std::string{test_name} + ": word across pages differs");
+
+  RAM copy{ram};
+  SHISA_CHECK_TEST(std::ranges::equal(copy, ram) &&
+                       copy.allocatedPages() == ram.allocatedPages(),
+                   std::string{test_name} + ": copy differs");
+  copy.write(0x0000, 0x56);
+  SHISA_CHECK_TEST(ram.read(0x0000) == 0x12,
+                   std::string{test_name} + ": copy shares pages");
+
+  const RAM moved{std::move(copy)};
+  SHISA_CHECK_TEST(moved.read(0x0000) == 0x56,
+                   std::string{test_name} + ": move lost the pages");
+} // }}}
+
+void testFork() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  RAM parent{};
+  parent.write(0x0000, 0x12);
+  parent.write(0x8000, 0x34);
+
+  const auto checkPages = [&](const RAM &ram, size_t allocated, size_t shared,
+                              const char *what) {
+    SHISA_CHECK_TEST(ram.allocatedPages() == allocated &&
+                         ram.sharedPages() == shared,
+                     std::string{test_name} + ": " +
+                         std::to_string(ram.allocatedPages()) + " pages, " +
+                         std::to_string(ram.sharedPages()) + " shared after " +
+                         what);
+  };
+
+  {
+    RAM child = parent.fork();
+    SHISA_CHECK_TEST(std::ranges::equal(child, parent),
+                     std::string{test_name} + ": fork differs");
+    checkPages(child, 2, 2, "fork");
+
+    child.write(0x0000, 0x56);
+    parent.write(0x8000, 0x78);
+    checkPages(child, 2, 0, "writes to both pages");
+    SHISA_CHECK_TEST(parent.read(0x0000) == 0x12 &&
+                         parent.read(0x8000) == 0x78 &&
+                         child.read(0x0000) == 0x56 &&
+                         child.read(0x8000) == 0x34,
+                     std::string{test_name} + ": write seen by the other RAM");
+
+    RAM grandchild = child.fork();
+    grandchild.write(0x4000, 0x9a);
+    checkPages(grandchild, 3, 2, "a write to a new page");
+  }
+
+  // the parent is the last holder of its pages, a write takes them over
+  parent.write(0x0001, 0xbc);
+  checkPages(parent, 2, 0, "the forks are gone");
+} // }}}
+
+void testDeduplicate() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  RAM first{};
+  RAM second{};
+  for (RAM *ram : {&first, &second}) {
+    ram->write(0x1000, 0x12);
+    ram->write(0x2000, 0x00); // a frame of zero cells
+  }
+  first.write(0x3000, 0x34);
+  second.write(0x3000, 0x56);
+
+  RAM::Deduplicator::Stats stats{};
+  {
+    RAM::Deduplicator dedup{};
+    first.deduplicate(dedup);
+    second.deduplicate(dedup);
+    stats = dedup.getStats();
+  }
+  SHISA_CHECK_TEST(stats.scannedPages == 6 && stats.mergedPages == 1 &&
+                       stats.zeroPages == 2 &&
+                       stats.savedBytes == 3 * RAM::pageCells * sizeof(Cell),
+                   std::string{test_name} + ": " +
+                       std::to_string(stats.mergedPages) + " merged, " +
+                       std::to_string(stats.zeroPages) + " zero, " +
+                       std::to_string(stats.savedBytes) + " bytes saved");
+  SHISA_CHECK_TEST(first.allocatedPages() == 2 &&
+                       second.allocatedPages() == 2 &&
+                       first.sharedPages() == 1 && second.sharedPages() == 1,
+                   std::string{test_name} + ": pages not shared");
+
+  // the merged frame is copy-on-write for both, also the one it came from
+  first.write(0x1001, 0x78);
+  second.write(0x1002, 0x9a);
+  SHISA_CHECK_TEST(first.read(0x1000) == 0x12 && first.read(0x1001) == 0x78 &&
+                       first.read(0x1002) == 0x00 &&
+                       second.read(0x1000) == 0x12 &&
+                       second.read(0x1001) == 0x00 &&
+                       second.read(0x1002) == 0x9a &&
+                       first.read(0x3000) == 0x34 &&
+                       second.read(0x3000) == 0x56,
+                   std::string{test_name} + ": write seen by the other RAM");
+} // }}}
+
+void testFootprint() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  using CPU = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS, RAM>;
+  SHISA_CHECK_TEST(sizeof(CPU) < 0x1000,
+                   std::string{test_name} + ": CPU of " +
+                       std::to_string(sizeof(CPU)) + " bytes");
+
+  std::vector<Inst> insts(3, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1)});
+  CPU               cpu{};
+  cpu.loadBin(Binary{ISAModule{insts}, {0xbeef}});
+  cpu.writeReg(0x5, 0xabcd);
+  cpu.storeRegOnStack(0x5);
+  cpu.loadRegFromStack(0x6);
+  SHISA_CHECK_TEST(cpu.readReg(0x6) == 0xabcd,
+                   std::string{test_name} + ": popped r6 == " +
+                       std::to_string(cpu.readReg(0x6)));
+} // }}}
+
+void testWideAddr() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  using WideRAM = shisa::fsim::PagedRAM<uint32_t, Cell>;
+  using CPU = shisa::fsim::CpuBase<Reg, uint32_t, Cell, shisa::NREGS, WideRAM>;
+
+  std::vector<Inst> insts(3, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1)});
+  CPU               cpu{};
+  cpu.loadBin(Binary{ISAModule{insts}, {0xbeef}});
+  cpu.writeWordToRAM(0xfffffffe, 0x1234);
+  cpu.writeWordToRAM(0x80000000, 0x5678);
+  SHISA_CHECK_TEST(cpu.readWordFromRAM(0xfffffffe) == 0x1234 &&
+                       cpu.readWordFromRAM(0x80000000) == 0x5678 &&
+                       cpu.readWordFromRAM(0x40000000) == 0x0000,
+                   std::string{test_name} + ": words of 32-bit RAM differ");
+
+  const std::vector<Cell> in = {0x01, 0x02, 0x03, 0x04};
+  std::vector<Cell>       out(in.size());
+  cpu.copyIn(0x12345ffe, in);
+  cpu.copyOut(0x12345ffe, out);
+  SHISA_CHECK_TEST(in == out,
+                   std::string{test_name} + ": cells copied across pages");
+
+  cpu.writeReg(0x5, 0xabcd);
+  cpu.storeRegOnStack(0x5);
+  cpu.loadRegFromStack(0x6);
+  SHISA_CHECK_TEST(cpu.readReg(0x6) == 0xabcd,
+                   std::string{test_name} + ": popped r6 == " +
+                       std::to_string(cpu.readReg(0x6)));
+
+  // a new RAM starts with the hashes of zero pages instead of reading them
+  CPU fresh{};
+  CPU zeroed{};
+  zeroed.writeWordToRAM(0x80000000, 0x0000);
+  SHISA_CHECK_TEST(fresh.hashRAM() == zeroed.hashRAM(),
+                   std::string{test_name} + ": new RAM hashes as nonzero");
+} // }}}
+
+
+
+int main() {
+  try {
+    testPagedRAM();
+    testFork();
+    testDeduplicate();
+    testFootprint();
+    testWideAddr();
+    shisa::test::SimTester<Reg, Addr, Cell, shisa::NREGS,
+                           PagedPredecodedSim>::runTests();
+    shisa::test::SimTester<Reg, Addr, Cell, shisa::NREGS,
+                           PagedHoistedSim>::runTests();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
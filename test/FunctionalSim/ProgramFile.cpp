@@ -0,0 +1,205 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <FunctionalSim/ProgramFile.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using Program = shisa::fsim::LoadedProgramBase<Addr, Cell>;
+using RAM     = shisa::fsim::PagedRAM<Addr, Cell>;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::fsim::Checksum;
+using shisa::fsim::ProgramFileHeader;
+
+using shisa::test::getStorePushBin;
+using shisa::test::resultAddr;
+using shisa::test::sameState;
+
+
+
+static auto tempPath(const std::string &name) -> std::string {
+  return shisa::test::tempPath(name, ".shbin");
+}
+
+static auto sameDecoded(const Program &a, const Program &b) -> bool {
+  return std::ranges::equal(a.getDecoded(), b.getDecoded(),
+                            [](const auto &x, const auto &y) {
+                              return x.opCode == y.opCode && x.dst == y.dst &&
+                                     x.srcL == y.srcL && x.srcR == y.srcR;
+                            });
+}
+
+void testMapProgram() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  const auto loaded = Program::load(getStorePushBin());
+  for (const bool predecoded : {true, false}) {
+    const std::string path = tempPath(predecoded ? "decoded" : "plain");
+    shisa::fsim::saveProgram(path, *loaded, predecoded);
+    const auto mapped = shisa::fsim::mapProgram<Addr, Cell>(path,
+                                                            Checksum::verify);
+    std::filesystem::remove(path);
+
+    SHISA_CHECK_TEST(mapped->getDataEnd() == loaded->getDataEnd() &&
+                         mapped->getBinEnd() == loaded->getBinEnd() &&
+                         std::ranges::equal(mapped->getImage(),
+                                            loaded->getImage()),
+                     std::string{test_name} + ": mapped image differs");
+    SHISA_CHECK_TEST(sameDecoded(*mapped, *loaded),
+                     std::string{test_name} +
+                         ": mapped instructions differ, predecoded " +
+                         std::to_string(predecoded));
+
+    // the image is the mapped file, so a sim of it shares its pages
+    RAM ram{};
+    ram.shareImage(mapped->getImage(), mapped);
+    SHISA_CHECK_TEST(ram.allocatedPages() == 0,
+                     std::string{test_name} + ": image pages copied");
+  }
+} // }}}
+
+template <class Sim>
+void testMappedSims(const std::string &test_name) { // {{{
+  const Binary      bin  = getStorePushBin();
+  const std::string path = tempPath("sims");
+  shisa::fsim::saveProgram<Addr, Cell>(path, bin);
+  const auto program = shisa::fsim::mapProgram<Addr, Cell>(path);
+  // the mapping outlives the file name
+  std::filesystem::remove(path);
+
+  Sim ref{bin};
+  Sim sim{program};
+  ref.executeAll();
+  sim.executeAll();
+  SHISA_CHECK_TEST(sameState(sim, ref) &&
+                       sim.getState().readWordFromRAM(resultAddr) == 0x0007,
+                   test_name + ": differs from a sim of the binary");
+} // }}}
+
+void testBadFile() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  const std::string path = tempPath("bad");
+  shisa::fsim::saveProgram<Addr, Cell>(path, getStorePushBin());
+  std::vector<char> good{};
+  {
+    std::ifstream in{path, std::ios::binary};
+    good.assign(std::istreambuf_iterator<char>{in}, {});
+  }
+
+  const auto fails = [&](const std::vector<char> &bytes, Checksum check) {
+    std::ofstream{path, std::ios::binary | std::ios::trunc}.write(
+        bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    try {
+      (void)shisa::fsim::mapProgram<Addr, Cell>(path, check);
+    } catch (const shisa::Exception &) {
+      return true;
+    }
+    return false;
+  };
+
+  std::vector<char> badMagic = good;
+  badMagic[0]                = 'X';
+  std::vector<char> badCell  = good;
+  badCell[shisa::fsim::sectionAlignment + 1] ^= 1;
+  const std::vector<char> truncated(good.begin(), good.begin() + 100);
+
+  // good with a header field or a predecoded one set to value
+  ProgramFileHeader header{};
+  std::memcpy(&header, good.data(), sizeof(header));
+  const auto patched = [&good](size_t offset, auto value) {
+    std::vector<char> bytes = good;
+    std::memcpy(bytes.data() + offset, &value, sizeof(value));
+    return bytes;
+  };
+  const auto hugeCells =
+      patched(offsetof(ProgramFileHeader, imageCells), ~uint64_t{0});
+  const auto hugeDecoded =
+      patched(offsetof(ProgramFileHeader, nDecoded), uint64_t{1} << 62);
+  const auto wideBinEnd =
+      patched(offsetof(ProgramFileHeader, binEnd), uint64_t{0x10000});
+  const auto badReg = patched(
+      header.decodedOffset + offsetof(Inst::DecodedInst, srcL), int{16});
+  const auto badOpCode = patched(
+      header.decodedOffset + offsetof(Inst::DecodedInst, opCode), int{-1});
+
+  // bytes with a matching checksum, so that only the field check fails
+  const auto resealed = [&header](std::vector<char> bytes) {
+    const auto all      = std::as_bytes(std::span{bytes});
+    const auto checksum = shisa::fsim::program_file_detail::checksumOf(
+        header, all.subspan(header.imageOffset, header.imageCells),
+        all.subspan(header.decodedOffset,
+                    header.nDecoded * header.decodedInstBytes));
+    std::memcpy(bytes.data() + offsetof(ProgramFileHeader, checksum),
+                &checksum, sizeof(checksum));
+    return bytes;
+  };
+
+  SHISA_CHECK_TEST(!fails(good, Checksum::verify),
+                   std::string{test_name} + ": good file rejected");
+  SHISA_CHECK_TEST(fails(badMagic, Checksum::skip),
+                   std::string{test_name} + ": bad magic accepted");
+  SHISA_CHECK_TEST(fails(truncated, Checksum::skip),
+                   std::string{test_name} + ": truncated file accepted");
+  SHISA_CHECK_TEST(fails(badCell, Checksum::verify) &&
+                       !fails(badCell, Checksum::skip),
+                   std::string{test_name} + ": wrong checksum check");
+  SHISA_CHECK_TEST(fails({}, Checksum::skip),
+                   std::string{test_name} + ": empty file accepted");
+  SHISA_CHECK_TEST(fails(hugeCells, Checksum::skip) &&
+                       fails(hugeDecoded, Checksum::skip),
+                   std::string{test_name} + ": overflowing sizes accepted");
+  SHISA_CHECK_TEST(fails(wideBinEnd, Checksum::skip),
+                   std::string{test_name} + ": binary out of the RAM accepted");
+  SHISA_CHECK_TEST(!fails(resealed(good), Checksum::verify) &&
+                       fails(resealed(badReg), Checksum::verify) &&
+                       fails(resealed(badOpCode), Checksum::verify),
+                   std::string{test_name} +
+                       ": predecoded fields out of range accepted");
+  std::filesystem::remove(path);
+} // }}}
+
+
+
+int main() {
+  try {
+    testMapProgram();
+    testMappedSims<shisa::fsim::PredecodedSim<>>(
+        "testMappedSims<PredecodedSim>");
+    testMappedSims<shisa::fsim::HoistedSim<Reg, Addr, Cell, shisa::NREGS,
+                                           RAM>>(
+        "testMappedSims<HoistedSim, PagedRAM>");
+    testBadFile();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -2,11 +2,13 @@
 #include <ShISA/Inst.hpp>
 #include <exceptions.hpp>
 
+#include <algorithm>
 #include <chrono>
 #include <exception>
 #include <iostream>
 #include <limits>
 #include <random>
+#include <sstream>
 #include <string>
 
 
@@ -49,6 +51,28 @@ void testRAM() {
 
 
 
+void testDump() {
+  constexpr auto test_name = __FUNCTION__;
+
+  RAM ram;
+  ram.write(std::numeric_limits<addr_t>::max(), 0xab);
+
+  std::ostringstream os;
+  ram.dump(os);
+  const std::string dump = os.str();
+
+  const auto nLines =
+      static_cast<size_t>(std::count(dump.begin(), dump.end(), '\n'));
+  SHISA_CHECK_TEST(nLines == RAM::nCells + 1,
+                   std::string{test_name} + ": " + std::to_string(nLines) +
+                       " lines dumped instead of " +
+                       std::to_string(RAM::nCells + 1));
+  SHISA_CHECK_TEST(dump.ends_with("0xffff = 0xab\n"),
+                   std::string{test_name} + ": last cell is not dumped last");
+}
+
+
+
 int main() {
   try {
 #if 0
@@ -56,6 +80,7 @@ int main() {
     testLazyRAM();
 #endif
     testRAM();
+    testDump();
   } catch (const shisa::test::Exception &e) {
     std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
     exit(EXIT_FAILURE);
@@ -1,8 +1,11 @@
+#include <FunctionalSim/PagedRAM.hpp>
 #include <FunctionalSim/RAMController.hpp>
 #include <ShISA/Inst.hpp>
 #include <exceptions.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <limits>
 #include <string>
 #include <vector>
@@ -65,7 +68,7 @@ auto getTestBin() -> Binary {
 
   Binary bin{std::move(M), std::move(binData)};
 
-  return std::move(bin);
+  return bin;
 }
 
 
@@ -187,11 +190,147 @@ void testRAMController() {
   }
 }
 
+void testWords() {
+  constexpr auto test_name = __FUNCTION__;
+
+  static_assert(RAMController::hasWordPath<uint16_t>,
+                "16-bit words of 8-bit cells must take the word path");
+
+  auto checkWord = [test_name](const RAMController &controller, Addr addr,
+                               uint16_t expected) {
+    const uint16_t word  = controller.readWord<uint16_t>(addr);
+    const uint16_t cells = controller.read(addr) << CHAR_BIT |
+                           controller.read(static_cast<Addr>(addr + 1));
+    SHISA_CHECK_TEST(word == expected && cells == expected,
+                     std::string{test_name} + ": word at " +
+                         std::to_string(addr) + " == " + std::to_string(word) +
+                         ", cells hold " + std::to_string(cells) +
+                         " but must be " + std::to_string(expected));
+  };
+
+  {
+    RAMController controller;
+    controller.writeWord<uint16_t>(0x1234, 0xabcd);
+    checkWord(controller, 0x1234, 0xabcd);
+
+    // the last word wraps around to cell 0
+    controller.writeWord<uint16_t>(0xffff, 0x5678);
+    checkWord(controller, 0xffff, 0x5678);
+    checkWord(controller, 0x0000, 0x7800);
+    controller.write(0x0000, 0x9a);
+    checkWord(controller, 0xffff, 0x569a);
+    controller.writeWord<uint16_t>(0x0000, 0xbcde);
+    checkWord(controller, 0xffff, 0x56bc);
+  }
+
+  {
+    RAMController controller;
+    controller.loadBin(getTestBin());
+    const Addr binEnd = controller.getBinEnd();
+
+    // only the cells outside of the binary are written
+    const uint16_t lastBinCell = controller.read(binEnd - 1);
+    controller.writeWord<uint16_t>(binEnd - 1, 0x1122);
+    checkWord(controller, binEnd - 1, lastBinCell << CHAR_BIT | 0x22);
+
+    const uint16_t firstWord = controller.readWord<uint16_t>(0x0000);
+    controller.writeWord<uint16_t>(0xffff, 0x3344);
+    checkWord(controller, 0xffff, 0x3300 | firstWord >> CHAR_BIT);
+    checkWord(controller, 0x0000, firstWord);
+  }
+}
+
+void testDirtyPages() {
+  constexpr auto test_name = __FUNCTION__;
+
+  constexpr Addr pageSize = RAMController::pageSize;
+
+  auto dirtyPages = [](const RAMController &controller) {
+    std::vector<Addr> pages;
+    controller.forEachDirtyPage([&](Addr first) { pages.push_back(first); });
+    return pages;
+  };
+
+  auto checkPages = [&](const RAMController &controller,
+                        const std::vector<Addr> &expected, const char *what) {
+    const std::vector<Addr> pages = dirtyPages(controller);
+    std::string             list;
+    for (const Addr first : pages) {
+      list += " " + std::to_string(first);
+    }
+    SHISA_CHECK_TEST(pages == expected, std::string{test_name} +
+                                            ": dirty pages after " + what +
+                                            " are" + list);
+  };
+
+  RAMController controller;
+  checkPages(controller, {}, "construction");
+
+  controller.loadBin(getTestBin());
+  checkPages(controller, {0x0000}, "loading the binary");
+  controller.clearDirtyPages();
+  checkPages(controller, {}, "clear");
+
+  // stores to the read-only binary are dropped
+  controller.write(0x0000, 0x12);
+  checkPages(controller, {}, "store to the binary");
+
+  controller.write(3 * pageSize + 5, 0x12);
+  controller.writeWord<uint16_t>(5 * pageSize - 1, 0x3456);
+  checkPages(controller, {3 * pageSize, 4 * pageSize, 5 * pageSize},
+             "stores");
+  SHISA_CHECK_TEST(controller.isPageDirty(4 * pageSize + 7) &&
+                       !controller.isPageDirty(6 * pageSize),
+                   std::string{test_name} + ": isPageDirty() differs");
+
+  controller.clearDirtyPages();
+  // the second cell wraps around into the binary
+  controller.writeWord<uint16_t>(0xffff, 0x7890);
+  checkPages(controller, {static_cast<Addr>(0x10000 - pageSize)},
+             "word store at the last address");
+
+  controller.clearDirtyPages();
+  controller.markDirty(pageSize - 1, pageSize + 2);
+  checkPages(controller, {0x0000, pageSize, 2 * pageSize}, "markDirty()");
+}
+
+
+
+// loadBin() lays the words out as splitBinary() does, in bulk or not
+template <class Controller>
+void testLoadBinCells(const std::string &test_name) {
+  using C = typename Controller::Cell;
+
+  const Binary bin = getTestBin();
+  auto         controller = std::make_unique<Controller>();
+  controller->loadBin(bin);
+
+  std::vector<C> expected(Controller::RAM::nCells);
+  const auto [dataEnd, binEnd] = Controller::splitBinary(
+      bin, [&](typename Controller::Addr addr, C cell) {
+        expected[addr] = cell;
+      });
+  SHISA_CHECK_TEST(controller->getProgramStart() == dataEnd &&
+                       controller->getBinEnd() == binEnd,
+                   test_name + ": wrong binary layout");
+  SHISA_CHECK_TEST(std::equal(expected.begin(), expected.end(),
+                              controller->begin()),
+                   test_name + ": cells differ from splitBinary()");
+}
+
 
 
 int main() {
   try {
     testRAMController();
+    testWords();
+    testDirtyPages();
+    testLoadBinCells<RAMController>("testLoadBinCells<RAMBase>");
+    testLoadBinCells<shisa::fsim::RAMControllerBase<Addr, uint16_t>>(
+        "testLoadBinCells<RAMBase, uint16_t>");
+    testLoadBinCells<shisa::fsim::RAMControllerBase<
+        Addr, Cell, shisa::fsim::PagedRAM<Addr, Cell>>>(
+        "testLoadBinCells<PagedRAM>");
   } catch (const shisa::test::Exception &e) {
     std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
     exit(EXIT_FAILURE);
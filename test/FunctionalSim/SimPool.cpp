@@ -0,0 +1,161 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/HoistedSim.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/PredecodedSim.hpp>
+#include <FunctionalSim/SimPool.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+
+constexpr Addr resultAddr = 0x2000;
+
+
+
+// stores the first data word at resultAddr, calls a function that changes
+// r2 and pushes r2
+static auto getTestBin() -> Binary {
+  ISAModule M{{
+      Inst::encode(OpCode::LD, 0x2, 0x0, 0x0),
+      Inst::encode(OpCode::ADD, 0x3, 0x1, 0x1),
+      Inst::encode(OpCode::LD, 0x4, 0x3, 0x0),
+      Inst::encode(OpCode::ST, 0x0, 0x4, 0x2),
+      Inst::encode(OpCode::ADD, 0x3, 0x3, 0x3),
+      Inst::encode(OpCode::LD, 0x5, 0x3, 0x0),
+      Inst::encode(OpCode::ADD, 0x6, 0x3, 0x1),
+      Inst::encode(OpCode::ADD, 0x6, 0x6, 0x1),
+      Inst::encode(OpCode::LD, 0x6, 0x6, 0x0),
+      Inst::encode(OpCode::CALL, 0x5, 0x0, 0x0),
+      Inst::encode(OpCode::PUSH, 0x0, 0x2, 0x0),
+      Inst::encode(OpCode::JTR, 0x0, 0x0, 0x6),
+      Inst::encode(OpCode::ADD, 0x2, 0x2, 0x1),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+  }};
+
+  // input, result address, function address, end address
+  return Binary{std::move(M), {0x0007, resultAddr, 0x0020, 0x0024}};
+}
+
+template <class Sim>
+void testSimPool(const std::string &test_name) { // {{{
+  using Data = shisa::Binary::Data;
+
+  const Binary                 bin = getTestBin();
+  shisa::fsim::SimPool<Sim>    pool{bin};
+  const Sim                    fresh{bin};
+  const typename Sim::CPU     &ref = fresh.getState();
+
+  auto checkFresh = [&](const Sim &sim, const char *what) {
+    const auto &state = sim.getState();
+    SHISA_CHECK_TEST(
+        std::ranges::equal(state.ram_range(), ref.ram_range()) &&
+            std::ranges::equal(state.regs_range(), ref.regs_range()) &&
+            state.getPC() == ref.getPC() && state.getSP() == ref.getSP() &&
+            sim.retiredInsts() == 0 && !state.endReached(),
+        test_name + ": sim differs from a new one " + what);
+  };
+
+  auto checkRun = [&](Sim &sim, Reg expected, const char *what) {
+    sim.executeAll();
+    const auto &state = sim.getState();
+    SHISA_CHECK_TEST(state.readWordFromRAM(resultAddr) == expected &&
+                         state.readWordFromRAM(state.getBinEnd()) ==
+                             expected &&
+                         state.getSP() == state.getBinEnd() + 2,
+                     test_name + ": wrong result " + what);
+  };
+
+  const Sim *first = nullptr;
+  {
+    auto lease = pool.acquire();
+    first      = &*lease;
+    checkFresh(*lease, "on the first acquire");
+    checkRun(*lease, 0x0007, "on the first run");
+  }
+  {
+    auto lease = pool.acquire();
+    SHISA_CHECK_TEST(&*lease == first && pool.size() == 1,
+                     test_name + ": released sim not reused");
+    checkFresh(*lease, "after a reset");
+    checkRun(*lease, 0x0007, "after a reset");
+  }
+  {
+    const std::vector<Data> input = {0x0009};
+    auto                    lease = pool.acquire(input);
+    checkRun(*lease, 0x0009, "with new data");
+
+    // the reset sim is taken, the leased one is not shared
+    auto other = pool.acquire();
+    SHISA_CHECK_TEST(&*other != &*lease && pool.size() == 2,
+                     test_name + ": leased sim acquired again");
+    checkFresh(*other, "on the second sim");
+  }
+  {
+    auto lease = pool.acquire();
+    checkFresh(*lease, "after new data");
+    checkRun(*lease, 0x0007, "after new data");
+  }
+
+  if constexpr (shisa::fsim::isDeduplicatingRAM<typename Sim::RAM>) {
+    // the stack pages written by the three runs are equal after the reset
+    {
+      auto a = pool.acquire();
+      auto b = pool.acquire();
+      auto c = pool.acquire();
+      for (auto *lease : {&a, &b, &c}) {
+        (*lease)->executeAll();
+      }
+    }
+    const auto stats = pool.deduplicate();
+    SHISA_CHECK_TEST(stats.mergedPages >= 2 && stats.savedBytes > 0,
+                     test_name + ": " + std::to_string(stats.mergedPages) +
+                         " pages merged");
+    auto lease = pool.acquire();
+    checkFresh(*lease, "after deduplication");
+    checkRun(*lease, 0x0007, "after deduplication");
+  }
+
+  try {
+    const std::vector<Data> input(8, 0x0001);
+    auto                    lease = pool.acquire(input);
+    SHISA_CHECK_TEST(false, test_name + ": data longer than the section");
+  } catch (const shisa::Exception &e) {
+  }
+} // }}}
+
+
+
+int main() {
+  try {
+    testSimPool<shisa::fsim::HoistedSim<>>("testSimPool<HoistedSim>");
+    testSimPool<shisa::fsim::PredecodedSim<>>("testSimPool<PredecodedSim>");
+    testSimPool<shisa::fsim::HoistedSim<Reg, Addr, Cell, shisa::NREGS,
+                                        shisa::fsim::PagedRAM<Addr, Cell>>>(
+        "testSimPool<HoistedSim, PagedRAM>");
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
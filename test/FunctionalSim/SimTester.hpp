@@ -3,9 +3,19 @@
 #include <FunctionalSim/Sim.hpp>
 #include <FunctionalSim/isSim.hpp>
 
+#include <algorithm>
 #include <concepts>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#endif
 
 
 
@@ -15,6 +25,78 @@
 
 namespace shisa::test {
 
+// The program shared by the tests of loaded programs, .shbin files and
+// checkpoints: it stores the first data word at resultAddr and pushes
+// r2 op 1.
+constexpr uint16_t resultAddr = 0x2000;
+
+inline auto getStorePushBin(OpCode op = OpCode::ADD) -> Binary {
+  ISAModule M{{
+      Inst::encode(OpCode::LD, 0x2, 0x0, 0x0),
+      Inst::encode(OpCode::ADD, 0x3, 0x1, 0x1),
+      Inst::encode(OpCode::LD, 0x4, 0x3, 0x0),
+      Inst::encode(OpCode::ST, 0x0, 0x4, 0x2),
+      Inst::encode(op, 0x2, 0x2, 0x1),
+      Inst::encode(OpCode::ADD, 0x0, 0x2, 0x2),
+      Inst::encode(OpCode::PUSH, 0x0, 0x2, 0x0),
+  }};
+
+  return Binary{std::move(M), {0x0007, resultAddr}};
+}
+
+// The loop of the event tests: it counts r4 up to nLoops, the handler at
+// eventHandlerAddr increments the word at eventCounterAddr.
+constexpr uint16_t eventCounterAddr = 0x2000;
+constexpr uint16_t eventHandlerAddr = 0x0022;
+
+inline auto getEventLoopBin(uint16_t nLoops) -> Binary {
+  ISAModule M{{
+      Inst::encode(OpCode::ADD, 0xf, 0x0, 0x0),
+      Inst::encode(OpCode::LD, 0xe, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0x3, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::ADD, 0xf, 0xf, 0x2),
+      Inst::encode(OpCode::LD, 0xd, 0xf, 0x0),
+      Inst::encode(OpCode::ADD, 0x4, 0x4, 0x1), // loop
+      Inst::encode(OpCode::CMP, 0x5, 0x3, 0x4),
+      Inst::encode(OpCode::XOR, 0x5, 0x5, 0x1),
+      Inst::encode(OpCode::JTR, 0x0, 0x5, 0xe),
+      Inst::encode(OpCode::JTR, 0x0, 0x0, 0xd),
+      Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1), // handler
+      Inst::encode(OpCode::ADD, 0xf, 0x2, 0x2),
+      Inst::encode(OpCode::LD, 0x6, 0xf, 0x0),
+      Inst::encode(OpCode::LD, 0x7, 0x6, 0x0),
+      Inst::encode(OpCode::ADD, 0x7, 0x7, 0x1),
+      Inst::encode(OpCode::ST, 0x0, 0x6, 0x7),
+      Inst::encode(OpCode::RET, 0x0, 0x0, 0x0),
+  }};
+
+  return Binary{std::move(M), {0x0018, nLoops, eventCounterAddr, 0x0030}};
+}
+
+#if __has_include(<unistd.h>)
+// a file name of this test process, e.g. tempPath("bad", ".shbin")
+inline auto tempPath(const std::string &name, const std::string &ext)
+    -> std::string {
+  return std::filesystem::temp_directory_path() /
+         ("ShISA-" + std::to_string(getpid()) + "-" + name + ext);
+}
+#endif
+
+// RAM, registers, PC, SP and the retired instructions are equal
+template <class SimA, class SimB>
+auto sameState(const SimA &a, const SimB &b) -> bool {
+  return std::ranges::equal(a.getState().ram_range(),
+                            b.getState().ram_range()) &&
+         std::ranges::equal(a.getState().regs_range(),
+                            b.getState().regs_range()) &&
+         a.getState().getPC() == b.getState().getPC() &&
+         a.getState().getSP() == b.getState().getSP() &&
+         a.retiredInsts() == b.retiredInsts();
+}
+
 template <typename reg_t, typename addr_t, typename cell_t, size_t n_regs,
           template <typename Reg, typename Addr, typename Cell, size_t NRegs>
           class Sim_>
@@ -234,12 +316,234 @@ public:
     }
   } // }}}
 
+  static void testWatchpoints() { // {{{
+    constexpr auto test_name = __FUNCTION__;
+
+    ISAModule M{{
+        Inst::encode(shisa::OpCode::ADD, 0x2, 0x1, 0x1),
+        Inst::encode(shisa::OpCode::ADD, 0xf, 0x0, 0x0),
+        Inst::encode(shisa::OpCode::LD, 0x3, 0xf, 0x0),
+        Inst::encode(shisa::OpCode::ADD, 0xf, 0xf, 0x2),
+        Inst::encode(shisa::OpCode::LD, 0x4, 0xf, 0x0),
+        Inst::encode(shisa::OpCode::ADD, 0xf, 0xf, 0x2),
+        Inst::encode(shisa::OpCode::LD, 0x5, 0xf, 0x0),
+        Inst::encode(shisa::OpCode::ST, 0x0, 0x5, 0x4),
+        Inst::encode(shisa::OpCode::ST, 0x0, 0x3, 0x4),
+        Inst::encode(shisa::OpCode::ADD, 0x6, 0x0, 0x1),
+        Inst::encode(shisa::OpCode::PUSH, 0x0, 0x4, 0x0),
+        Inst::encode(shisa::OpCode::ADD, 0x7, 0x0, 0x1),
+        Inst::encode(shisa::OpCode::ST, 0x0, 0x3, 0x5),
+    }};
+
+    Binary::BinaryData data = {0x2000, 0xbeef, 0x2010};
+
+    const Binary bin{std::move(M), std::move(data)};
+    Sim          sim{bin};
+
+    const auto &state      = sim.getState();
+    const Addr  stackStart = state.getSP();
+    sim.addWatchpoint(0x2000, 2);
+    // the pushed word covers the watched cell through its second cell
+    sim.addWatchpoint(stackStart + 1);
+
+    const auto expectedHits = {
+        std::tuple<Addr, Reg, Reg, Reg>{0x2000, 0x0000, 0xbeef, 0x0000},
+        std::tuple<Addr, Reg, Reg, Reg>{stackStart, 0x0000, 0xbeef, 0x0001},
+    };
+
+    for (const auto [addr, oldValue, newValue, r6Value] : expectedHits) {
+      try {
+        sim.executeAll();
+        SHISA_CHECK_TEST(false, std::string{test_name} +
+                                    ": watchpoint at address " +
+                                    std::to_string(addr) + " wasn't hit");
+      } catch (const shisa::Watchpoint<Addr, Reg> &w) {
+        SHISA_CHECK_TEST(addr == w.address() && oldValue == w.oldValue() &&
+                             newValue == w.newValue(),
+                         std::string{test_name} + ": unexpected hit " +
+                             w.what() + ", expected address " +
+                             std::to_string(addr));
+      }
+      const Reg regValue = state.readReg(0x6);
+      SHISA_CHECK_TEST(r6Value == regValue,
+                       std::string{test_name} + ": r6 == " +
+                           std::to_string(regValue) + " but must be r6 == " +
+                           std::to_string(r6Value) + " after watchpoint hit");
+    }
+
+    sim.removeWatchpoint(0x2000, 2);
+    sim.executeAll();
+
+    const auto testCases = {
+        std::pair(0x6, 0x0001),
+        std::pair(0x7, 0x0001),
+    };
+
+    for (const auto [r, expectedRegValue] : testCases) {
+      const Reg regValue = state.readReg(r);
+      SHISA_CHECK_TEST(expectedRegValue == regValue,
+                       std::string{test_name} + ": r" + std::to_string(r) +
+                           " == " + std::to_string(regValue) +
+                           " but must be r" + std::to_string(r) +
+                           " == " + std::to_string(expectedRegValue));
+    }
+
+    const Reg stored = state.readWordFromRAM(0x2000);
+    SHISA_CHECK_TEST(0x2010 == stored,
+                     std::string{test_name} + ": last store wrote " +
+                         std::to_string(stored) + " instead of 8208");
+  } // }}}
+
+  static void testStopRequest() { // {{{
+    constexpr auto test_name = __FUNCTION__;
+
+    ISAModule M{{
+        Inst::encode(shisa::OpCode::ADD, 0xf, 0x0, 0x0),
+        Inst::encode(shisa::OpCode::LD, 0x3, 0xf, 0x0),
+        Inst::encode(shisa::OpCode::ADD, 0x4, 0x4, 0x1),
+        Inst::encode(shisa::OpCode::JTR, 0x0, 0x0, 0x3),
+    }};
+
+    Binary::BinaryData data = {0x0006};
+
+    const Binary bin{std::move(M), std::move(data)};
+    Sim          sim{bin};
+
+    const auto &state = sim.getState();
+    for (const auto iteration : std::views::iota(0, 2)) {
+      bool        stopped = false;
+      std::thread runner{[&sim, &stopped]() {
+        try {
+          sim.executeAll();
+        } catch (const shisa::StopRequested &e) {
+          stopped = true;
+        }
+      }};
+      sim.requestStop();
+      runner.join();
+
+      SHISA_CHECK_TEST(stopped, std::string{test_name} +
+                                    ": endless loop wasn't stopped on "
+                                    "iteration " +
+                                    std::to_string(iteration));
+      SHISA_CHECK_TEST(!sim.isStopRequested(),
+                       std::string{test_name} +
+                           ": stop request wasn't consumed on iteration " +
+                           std::to_string(iteration));
+
+      const Addr PC         = state.getPC();
+      const Addr PCExpected = 0x0006;
+      SHISA_CHECK_TEST(PCExpected == PC,
+                       std::string{test_name} + ": PC set to " +
+                           std::to_string(PC) + " instead of " +
+                           std::to_string(PCExpected) + " after stop");
+
+      const Reg regValue         = state.readReg(0x4);
+      const Reg expectedRegValue = iteration + 1;
+      SHISA_CHECK_TEST(expectedRegValue <= regValue,
+                       std::string{test_name} + ": r4 == " +
+                           std::to_string(regValue) +
+                           " but must be at least " +
+                           std::to_string(expectedRegValue) +
+                           " after resume");
+    }
+  } // }}}
+
+  static void testEvents() { // {{{
+    constexpr auto test_name = __FUNCTION__;
+
+    constexpr Addr nLoops      = 100;
+    constexpr Addr counterAddr = eventCounterAddr;
+    constexpr Addr handlerAddr = eventHandlerAddr;
+
+    const Binary bin = getEventLoopBin(nLoops);
+
+    constexpr size_t loopLength    = 4;
+    constexpr size_t handlerLength = 7;
+    constexpr size_t nInsts        = 8 + nLoops * loopLength + 1;
+
+    // deadline, period, handler runs
+    const auto testCases = {
+        std::tuple<size_t, size_t, size_t>{0, 0, 0},
+        std::tuple<size_t, size_t, size_t>{20, 0, 1},
+        std::tuple<size_t, size_t, size_t>{0, 100, 5},
+    };
+
+    for (const auto [at, period, nRuns] : testCases) {
+      Sim sim{bin};
+      if (nRuns != 0) {
+        sim.scheduleEvent(at, handlerAddr, period);
+      }
+      sim.executeAll();
+
+      const auto &state    = sim.getState();
+      const Reg   counter  = state.readWordFromRAM(counterAddr);
+      const Reg   regValue = state.readReg(0x4);
+      SHISA_CHECK_TEST(nRuns == counter && nLoops == regValue,
+                       std::string{test_name} + ": handler ran " +
+                           std::to_string(counter) + " times instead of " +
+                           std::to_string(nRuns) + ", r4 == " +
+                           std::to_string(regValue) + " but must be r4 == " +
+                           std::to_string(nLoops));
+
+      const size_t retired         = sim.retiredInsts();
+      const size_t retiredExpected = nInsts + nRuns * handlerLength;
+      SHISA_CHECK_TEST(retiredExpected == retired,
+                       std::string{test_name} + ": " +
+                           std::to_string(retired) +
+                           " instructions retired instead of " +
+                           std::to_string(retiredExpected));
+    }
+  } // }}}
+
+  static void testFork() { // {{{
+    constexpr auto test_name = __FUNCTION__;
+
+    // the loop of testEvents() with a periodic handler counting in RAM
+    constexpr Addr counterAddr = eventCounterAddr;
+    constexpr Addr handlerAddr = eventHandlerAddr;
+
+    const Binary bin = getEventLoopBin(100);
+
+    Sim ref{bin};
+    Sim parent{bin};
+    for (Sim *sim : {&ref, &parent}) {
+      sim->scheduleEvent(0, handlerAddr, 100);
+      for (int i = 0; i < 150; i++) {
+        sim->executeOne();
+      }
+    }
+
+    auto       child   = parent.fork();
+    const Reg  counter = parent.getState().readWordFromRAM(counterAddr);
+    const auto retired = parent.retiredInsts();
+    parent.executeAll();
+    SHISA_CHECK_TEST(child->getState().readWordFromRAM(counterAddr) ==
+                             counter &&
+                         child->retiredInsts() == retired,
+                     std::string{test_name} + ": fork sees the parent run");
+
+    child->executeAll();
+    ref.executeAll();
+    for (const Sim *sim : {&parent, child.get()}) {
+      const Reg counterEnd = sim->getState().readWordFromRAM(counterAddr);
+      SHISA_CHECK_TEST(sameState(*sim, ref) && counterEnd == 5,
+                       std::string{test_name} +
+                           ": run after the fork differs, counter == " +
+                           std::to_string(counterEnd));
+    }
+  } // }}}
+
   static void runTests() {
     try {
       testArithmetic();
       testJump();
       testMemory();
       testFuncs();
+      testWatchpoints();
+      testStopRequest();
+      testEvents();
+      testFork();
     } catch (const shisa::test::Exception &e) {
       std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
       exit(EXIT_FAILURE);
@@ -0,0 +1,194 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/CPU.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/StateCompare.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using CPU      = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS>;
+using PagedCPU = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS,
+                                      shisa::fsim::PagedRAM<Addr, Cell>>;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+using shisa::fsim::DiffRange;
+
+
+
+static auto getTestBin() -> Binary {
+  std::vector<Inst> insts(3, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1)});
+  return Binary{ISAModule{insts}, {0xbeef, 0xdead}};
+}
+
+void testCells() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  std::vector<Cell> a(1000);
+  for (size_t i = 0; i < a.size(); i++) {
+    a[i] = static_cast<Cell>(i * 7);
+  }
+  std::vector<Cell> b = a;
+  SHISA_CHECK_TEST(shisa::fsim::cellsEqual<Cell>(a, b) &&
+                       shisa::fsim::firstDifference<Cell>(a, b) == a.size(),
+                   std::string{test_name} + ": equal cells differ");
+
+  b[100] ^= 1;
+  b[101] ^= 1;
+  b[999] ^= 1;
+  SHISA_CHECK_TEST(!shisa::fsim::cellsEqual<Cell>(a, b) &&
+                       shisa::fsim::firstDifference<Cell>(a, b) == 100,
+                   std::string{test_name} + ": first difference not found");
+
+  std::vector<DiffRange> ranges{};
+  shisa::fsim::diffCells<Cell>(std::span{a}.first(500),
+                               std::span{b}.first(500), 0, ranges);
+  shisa::fsim::diffCells<Cell>(std::span{a}.subspan(500),
+                               std::span{b}.subspan(500), 500, ranges);
+  const std::vector<DiffRange> expected = {{100, 2}, {999, 1}};
+  SHISA_CHECK_TEST(ranges == expected,
+                   std::string{test_name} + ": wrong diff of " +
+                       std::to_string(ranges.size()) + " ranges");
+
+  // split at every size, the hash is of the bytes only
+  const uint64_t whole = shisa::fsim::hashCells<Cell>(a);
+  for (const size_t split : {0, 1, 31, 32, 33, 500}) {
+    shisa::fsim::StateHasher hasher{};
+    hasher.update(std::span<const Cell>{a}.first(split));
+    hasher.update(std::span<const Cell>{a}.subspan(split));
+    SHISA_CHECK_TEST(hasher.digest() == whole,
+                     std::string{test_name} + ": hash depends on split at " +
+                         std::to_string(split));
+  }
+  SHISA_CHECK_TEST(shisa::fsim::hashCells<Cell>(b) != whole,
+                   std::string{test_name} + ": hash of different cells");
+} // }}}
+
+template <class State>
+void testStates(const std::string &test_name) { // {{{
+  const Binary bin = getTestBin();
+  State        a{};
+  State        b{};
+  a.loadBin(bin);
+  b.loadBin(bin);
+  a.clearDirtyPages();
+  SHISA_CHECK_TEST(shisa::fsim::ramEqual(a, b) &&
+                       !shisa::fsim::firstRAMDifference(a, b) &&
+                       shisa::fsim::diffRAM(a, b).empty() &&
+                       a.hashRAM() == b.hashRAM(),
+                   test_name + ": loaded states differ");
+
+  a.writeWordToRAM(0x2000, 0x1234);
+  a.writeWordToRAM(0x5ffe, 0x5678);
+  a.writeWordToRAM(0x6000, 0x9abc);
+  const std::vector<DiffRange> expected = {{0x2000, 2}, {0x5ffe, 4}};
+  const auto found = shisa::fsim::firstRAMDifference(a, b);
+  SHISA_CHECK_TEST(!shisa::fsim::ramEqual(a, b) && found && *found == 0x2000,
+                   test_name + ": difference not found");
+  SHISA_CHECK_TEST(shisa::fsim::diffRAM(a, b) == expected,
+                   test_name + ": wrong diff");
+  SHISA_CHECK_TEST(shisa::fsim::diffDirtyRAM(a, b) == expected,
+                   test_name + ": wrong diff of the dirty pages");
+  SHISA_CHECK_TEST(a.hashRAM() != b.hashRAM(),
+                   test_name + ": hash of different RAM");
+
+  b.writeWordToRAM(0x2000, 0x1234);
+  b.writeWordToRAM(0x5ffe, 0x5678);
+  b.writeWordToRAM(0x6000, 0x9abc);
+  SHISA_CHECK_TEST(shisa::fsim::statesEqual(a, b) &&
+                       a.stateHash() == b.stateHash(),
+                   test_name + ": equal states differ");
+  a.writeReg(0x5, 0x1);
+  SHISA_CHECK_TEST(!shisa::fsim::statesEqual(a, b) &&
+                       a.stateHash() != b.stateHash(),
+                   test_name + ": states with different registers equal");
+
+  // the hash is of the cells only, not of the RAM layout
+  CPU flat{};
+  flat.loadBin(bin);
+  flat.writeWordToRAM(0x2000, 0x1234);
+  flat.writeWordToRAM(0x5ffe, 0x5678);
+  flat.writeWordToRAM(0x6000, 0x9abc);
+  SHISA_CHECK_TEST(flat.hashRAM() == b.hashRAM(),
+                   test_name + ": hash differs from the one of RAMBase");
+} // }}}
+
+template <class State>
+void testIncrementalHash(const std::string &test_name) { // {{{
+  const Binary bin = getTestBin();
+  State        image{};
+  image.loadBin(bin);
+  image.clearDirtyPages();
+
+  State cpu{image};
+  const uint64_t loaded = cpu.stateHash();
+
+  // the hash of a state loaded again with the same writes from scratch
+  std::vector<std::pair<Addr, Reg>> writes{};
+  const auto check = [&](const char *what) {
+    State ref{};
+    ref.loadBin(bin);
+    for (const auto &[addr, data] : writes) {
+      ref.writeWordToRAM(addr, data);
+    }
+    const State &constCPU = cpu;
+    SHISA_CHECK_TEST(constCPU.stateHash() == ref.stateHash() &&
+                         cpu.stateHash() == ref.stateHash(),
+                     test_name + ": hash differs from a full one " + what);
+  };
+
+  writes.emplace_back(0x2000, 0x1234);
+  cpu.writeWordToRAM(0x2000, 0x1234);
+  check("after a write");
+  // the page hashed just now is written again
+  writes.emplace_back(0x2002, 0x5678);
+  cpu.writeWordToRAM(0x2002, 0x5678);
+  check("after a write to a hashed page");
+
+  const std::vector<Cell> cells(0x900, 0xab);
+  for (size_t i = 0; i < cells.size(); i += 2) {
+    writes.emplace_back(static_cast<Addr>(0x8000 + i), 0xabab);
+  }
+  cpu.copyIn(0x8000, cells);
+  check("after a bulk copy");
+
+  cpu.resetTo(image);
+  SHISA_CHECK_TEST(cpu.stateHash() == loaded,
+                   test_name + ": hash after a reset differs");
+} // }}}
+
+
+
+int main() {
+  try {
+    testCells();
+    testStates<CPU>("testStates<RAMBase>");
+    testStates<PagedCPU>("testStates<PagedRAM>");
+    testIncrementalHash<CPU>("testIncrementalHash<RAMBase>");
+    testIncrementalHash<PagedCPU>("testIncrementalHash<PagedRAM>");
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,150 @@
+#include "SimTester.hpp"
+
+#include <FunctionalSim/CPU.hpp>
+#include <FunctionalSim/PagedRAM.hpp>
+#include <FunctionalSim/StateDump.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+
+using Reg  = uint16_t;
+using Addr = uint16_t;
+using Cell = uint8_t;
+
+using CPU      = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS>;
+using PagedCPU = shisa::fsim::CpuBase<Reg, Addr, Cell, shisa::NREGS,
+                                      shisa::fsim::PagedRAM<Addr, Cell>>;
+
+using shisa::Binary;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+using shisa::fsim::DumpCells;
+using shisa::fsim::StateDump;
+
+
+
+static auto getTestBin() -> Binary {
+  std::vector<Inst> insts(3, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1, 0x1)});
+  return Binary{ISAModule{insts}, {0xbeef, 0xdead}};
+}
+
+template <class State>
+void testDump(const std::string &test_name) { // {{{
+  State cpu{};
+  cpu.loadBin(getTestBin());
+  cpu.writeReg(0x5, 0xabcd);
+  cpu.writeWordToRAM(0x2000, 0x1234);
+  cpu.writeWordToRAM(0x2004, 0x5678);
+  cpu.writeWordToRAM(0x2100, 0x00ff);
+  cpu.writeWordToRAM(0x3000, 0x1234);
+  cpu.writeWordToRAM(0x300a, 0x5678);
+  cpu.writeWordToRAM(0x3013, 0x9abc);
+
+  const StateDump dump = shisa::fsim::makeStateDump(cpu);
+  SHISA_CHECK_TEST(dump.regs.size() == shisa::NREGS &&
+                       dump.regs[0x5] == 0xabcd && dump.SP == cpu.getSP() &&
+                       dump.binEnd == cpu.getBinEnd(),
+                   test_name + ": wrong registers");
+  // gaps of less than 8 zeros stay inside a run, the zeros around runs are
+  // dropped
+  const std::vector<StateDump::Run> expected = {
+      {0x2000, {0x12, 0x34, 0x00, 0x00, 0x56, 0x78}},
+      {0x2101, {0xff}},
+      {0x3000, {0x12, 0x34}},
+      {0x300a, {0x56, 0x78, 0, 0, 0, 0, 0, 0, 0, 0x9a, 0xbc}}};
+  SHISA_CHECK_TEST(dump.runs.size() > expected.size() &&
+                       dump.runs.front().addr == 0 &&
+                       std::equal(expected.begin(), expected.end(),
+                                  dump.runs.end() - expected.size()),
+                   test_name + ": wrong runs of cells");
+
+  std::stringstream binary{};
+  cpu.dumpBinary(binary);
+  SHISA_CHECK_TEST(shisa::fsim::readBinary(binary) == dump,
+                   test_name + ": binary dump read back differs");
+
+  std::stringstream text{};
+  cpu.dumpText(text);
+  const std::string str = text.str();
+  for (const std::string line :
+       {"r5  = 0xabcd\n", "0x0000: be ef de ad",
+        "\n0x2000: 12 34 00 00 56 78\n0x2101: ff\n"}) {
+    SHISA_CHECK_TEST(str.find(line) != std::string::npos,
+                     test_name + ": no \"" + line + "\" in the text dump");
+  }
+} // }}}
+
+template <class State>
+void testDirtyDump(const std::string &test_name) { // {{{
+  constexpr size_t pageSize =
+      std::min(State::RAMController::pageSize, State::RAM::nCells);
+
+  State cpu{};
+  cpu.loadBin(getTestBin());
+  cpu.clearDirtyPages();
+  cpu.writeWordToRAM(0x2002, 0x1234);
+
+  const StateDump dump = shisa::fsim::makeStateDump(cpu, DumpCells::dirty);
+  SHISA_CHECK_TEST(dump.runs.size() == 1 &&
+                       dump.runs[0].addr == (0x2002 & ~(pageSize - 1)) &&
+                       dump.runs[0].cells.size() == pageSize &&
+                       dump.runs[0].cells[0x2002 - dump.runs[0].addr] == 0x12,
+                   test_name + ": wrong dirty page dump");
+} // }}}
+
+void testBadDump() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  CPU cpu{};
+  cpu.loadBin(getTestBin());
+  std::stringstream binary{};
+  cpu.dumpBinary(binary);
+  const std::string good = binary.str();
+
+  std::string badMagic = good;
+  badMagic[0]          = 'X';
+  for (const std::string &bad :
+       {badMagic, good.substr(0, good.size() - 1), std::string{}}) {
+    std::stringstream in{bad};
+    try {
+      (void)shisa::fsim::readBinary(in);
+      SHISA_CHECK_TEST(false, std::string{test_name} + ": bad dump of " +
+                                  std::to_string(bad.size()) +
+                                  " bytes read without an exception");
+    } catch (const shisa::test::Exception &) {
+      throw;
+    } catch (const shisa::Exception &) {
+    }
+  }
+} // }}}
+
+
+
+int main() {
+  try {
+    testDump<CPU>("testDump<RAMBase>");
+    testDump<PagedCPU>("testDump<PagedRAM>");
+    testDirtyDump<CPU>("testDirtyDump<RAMBase>");
+    testDirtyDump<PagedCPU>("testDirtyDump<PagedRAM>");
+    testBadDump();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
@@ -0,0 +1,108 @@
+#include <ShISA/Binary.hpp>
+#include <ShISA/ISAModule.hpp>
+#include <ShISA/Inst.hpp>
+#include <exceptions.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+// Every allocation of the test is counted, so a copy in the pipeline from
+// the instruction vectors to a Binary shows up as one.
+static size_t nAllocs = 0;
+
+auto operator new(size_t size) -> void * {
+  nAllocs++;
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc{};
+}
+
+// GCC takes the free() of memory from operator new for a mismatch
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, size_t /*size*/) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+
+
+using shisa::Binary;
+using shisa::BinaryView;
+using shisa::Inst;
+using shisa::ISAModule;
+using shisa::OpCode;
+
+void testMoves() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  std::vector<Inst> insts(1000, Inst{Inst::encode(OpCode::ADD, 0x2, 0x1,
+                                                  0x1)});
+  Binary::BinaryData data(100, 0xbeef);
+  const Inst        *instsData = insts.data();
+  const auto        *binData   = data.data();
+
+  const size_t before = nAllocs;
+  ISAModule    M{std::move(insts)};
+  Binary       bin{std::move(M), std::move(data)};
+  Binary       moved{std::move(bin)};
+  SHISA_CHECK_TEST(nAllocs == before,
+                   std::string{test_name} + ": " +
+                       std::to_string(nAllocs - before) +
+                       " allocations moving into a Binary");
+  SHISA_CHECK_TEST(moved.getISAModule().getInsts().data() == instsData &&
+                       moved.getRawData().data() == binData &&
+                       moved.nInsts() == 1000 && moved.nData() == 100,
+                   std::string{test_name} + ": vectors copied");
+} // }}}
+
+void testView() { // {{{
+  constexpr auto test_name = __FUNCTION__;
+
+  const Binary bin{ISAModule{{Inst{0x1210}, Inst{0xa500}}}, {0x0005}};
+
+  const size_t     before = nAllocs;
+  const BinaryView view   = bin;
+  const BinaryView copy   = view;
+  SHISA_CHECK_TEST(nAllocs == before,
+                   std::string{test_name} + ": view allocates");
+  SHISA_CHECK_TEST(copy.getInsts().data() ==
+                           bin.getISAModule().getInsts().data() &&
+                       copy.getRawData().data() == bin.getRawData().data() &&
+                       copy.nInsts() == 2 && copy.nData() == 1,
+                   std::string{test_name} + ": view differs from the binary");
+
+  // a view of words kept elsewhere
+  const std::vector<Inst>     insts = {Inst{0x1310}};
+  const std::vector<uint16_t> words = {0x1, 0x2, 0x3};
+  const BinaryView            other{insts, words};
+  SHISA_CHECK_TEST(other.nInsts() == 1 && other.getRawData()[2] == 0x3,
+                   std::string{test_name} + ": wrong view of spans");
+} // }}}
+
+
+
+int main() {
+  try {
+    testMoves();
+    testView();
+  } catch (const shisa::test::Exception &e) {
+    std::cerr << __FILE__ ": test fail: " << e.what() << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (const std::exception &e) {
+    std::cerr << __FILE__ ": test fail: exception caught in main: " << e.what()
+              << std::endl;
+    exit(EXIT_FAILURE);
+  } catch (...) {
+    std::cerr << __FILE__ ": test fail: unknown exception caught in main"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
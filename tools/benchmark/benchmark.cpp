@@ -1,5 +1,6 @@
 #include "benchmark.hpp"
 
+#include <FunctionalSim/HoistedSim.hpp>
 #include <FunctionalSim/PredecodedSim.hpp>
 #include <FunctionalSim/PredecodedSubroutinedSim.hpp>
 #include <FunctionalSim/SubroutinedSim.hpp>
@@ -11,6 +12,7 @@
 #include <chrono>
 #include <ranges>
 
+using HoistedSim               = shisa::fsim::HoistedSim<>;
 using PredecodedSim            = shisa::fsim::PredecodedSim<>;
 using PredecodedSubroutinedSim = shisa::fsim::PredecodedSubroutinedSim<>;
 using SubroutinedSim           = shisa::fsim::SubroutinedSim<>;
@@ -36,6 +38,10 @@ auto getFlagName(Flags flag) -> std::string {
     return "Function with nops in loop:";
   case benchmark::FIBONACCI:
     return "Fibonacci:";
+  case benchmark::MEMORY_COPY:
+    return "Memory copy:";
+  case benchmark::PUSH_POP_IN_LOOP:
+    return "Push and pop in loop:";
   default:
     return "Unknown flag:";
   }
@@ -50,9 +56,14 @@ public:
 
   using Sim = Sim_;
 
+  static constexpr bool hasJumpCache =
+      requires(const Sim &s) { s.getJumpCacheStats(); };
+
 private:
   std::array<bool, Flags::NUMBER_OF_FLAGS>     measured{false};
   std::array<Duration, Flags::NUMBER_OF_FLAGS> durations;
+  std::array<uint64_t, Flags::NUMBER_OF_FLAGS> retired;
+  std::array<double, Flags::NUMBER_OF_FLAGS>   jumpCacheHitRates{};
 
 public:
   void run(Flags flag) {
@@ -61,7 +72,15 @@ public:
     sim.executeAll();
     Time end        = Clock::now();
     durations[flag] = end - start;
+    retired[flag]   = sim.retiredInsts();
     measured[flag]  = true;
+
+    if constexpr (hasJumpCache) {
+      const auto &stats = sim.getJumpCacheStats();
+      const auto  total = stats.hits + stats.misses;
+      jumpCacheHitRates[flag] =
+          total == 0 ? 0.0 : 100.0 * static_cast<double>(stats.hits) / total;
+    }
   }
 
   auto getDuration(Flags flag) -> Duration {
@@ -71,6 +90,22 @@ public:
 
     return durations[flag];
   }
+
+  auto getMIPS(Flags flag) -> double {
+    if (!measured[flag]) {
+      run(flag);
+    }
+
+    return static_cast<double>(retired[flag]) / durations[flag].count() / 1e6;
+  }
+
+  auto getJumpCacheHitRate(Flags flag) -> double {
+    if (!measured[flag]) {
+      run(flag);
+    }
+
+    return jumpCacheHitRates[flag];
+  }
 };
 
 #if 0
@@ -93,11 +128,17 @@ int main() {
   Benchmark<PredecodedSubroutinedSim> b2{};
   Benchmark<SubroutinedSim>           b3{};
   Benchmark<SwitchedSim>              b4{};
+  Benchmark<HoistedSim>               b5{};
 
   auto processBenchmark = [](auto b, benchmark::Flags flag) {
     std::cout << std::setw(25) << std::left
               << shisa::fsim::getSimName<typename decltype(b)::Sim>() << " "
-              << std::fixed << b.getDuration(flag).count() << '\n';
+              << std::fixed << b.getDuration(flag).count() << " "
+              << std::setprecision(1) << b.getMIPS(flag) << " MIPS";
+    if constexpr (decltype(b)::hasJumpCache) {
+      std::cout << ", jump cache hits " << b.getJumpCacheHitRate(flag) << "%";
+    }
+    std::cout << std::setprecision(6) << '\n';
   };
 
   for (const benchmark::Flags flag : {
@@ -108,12 +149,15 @@ int main() {
            benchmark::NESTED_LOOPS,
            benchmark::ONE_LONG_LOOP,
            benchmark::FUNCTION_WITH_NOPS_IN_LOOP,
+           benchmark::MEMORY_COPY,
+           benchmark::PUSH_POP_IN_LOOP,
        }) {
     std::cout << benchmark::getFlagName(flag) << '\n';
     processBenchmark(b1, flag);
     processBenchmark(b2, flag);
     processBenchmark(b3, flag);
     processBenchmark(b4, flag);
+    processBenchmark(b5, flag);
     std::cout << std::endl;
   }
 }
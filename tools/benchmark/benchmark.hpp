@@ -12,6 +12,8 @@ enum Flags {
   FUNCTION_IN_LOOP,
   FUNCTION_WITH_NOPS_IN_LOOP,
   FIBONACCI,
+  MEMORY_COPY,
+  PUSH_POP_IN_LOOP,
   NUMBER_OF_FLAGS
 };
 
@@ -47,11 +47,11 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
   };
   switch (flag) {
   case Flags::ONLY_NOPS:
-    return std::move(ISAModule{std::move(std::vector<shisa::Inst>(
-        static_cast<size_t>(MAX_N_INSTS), INST(ADD, r0, r0, r0)))});
+    return ISAModule{std::vector<shisa::Inst>(
+        static_cast<size_t>(MAX_N_INSTS), INST(ADD, r0, r0, r0))};
 
   case Flags::ONE_LOOP:
-    return std::move(ISAModule{{
+    return ISAModule{{
         INST(ADD, rf, r0, r0),
         INST(LD, r3, rf, r0),
         INST(ADD, r2, r1, r1),
@@ -62,7 +62,7 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
         INST(XOR, r5, r5, r1),
         INST(JTR, r0, r5, re),
         INST(ADD, r0, r0, r0),
-    }});
+    }};
 
   case Flags::ONE_LONG_LOOP: {
     std::vector<shisa::Inst> insts{
@@ -81,11 +81,11 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
                  std::make_move_iterator(nops.end()));
     insts.emplace_back(INST(JTR, r0, r5, re));
 
-    return std::move(ISAModule{std::move(insts)});
+    return ISAModule{std::move(insts)};
   }
 
   case Flags::NESTED_LOOPS:
-    return std::move(ISAModule{{
+    return ISAModule{{
         INST(ADD, rf, r0, r0),
         INST(LD, r3, rf, r0),
         INST(ADD, r2, r1, r1),
@@ -101,10 +101,10 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
         INST(XOR, r5, r5, r1), //
         INST(JTR, r0, r5, re), // external loop
         INST(ADD, r0, r0, r0),
-    }});
+    }};
 
   case Flags::FUNCTION_IN_LOOP:
-    return std::move(ISAModule{{
+    return ISAModule{{
         INST(ADD, rf, r0, r0),  // rf = 0x0
         INST(ADD, r2, r1, r1),  //
         INST(LD, re, rf, r0),   // load loop addr
@@ -140,7 +140,7 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
         INST(ST, r0, r6, r5),   // store return value
         INST(RET, r0, r0, r0),  //
         INST(ADD, r0, r0, r0),  //
-    }});
+    }};
 
   case Flags::FUNCTION_WITH_NOPS_IN_LOOP: {
     std::vector<shisa::Inst> insts{
@@ -192,11 +192,11 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
                  std::make_move_iterator(nops.end()));
     insts.insert(insts.end(), std::make_move_iterator(funcEnd.begin()),
                  std::make_move_iterator(funcEnd.end()));
-    return std::move(ISAModule{std::move(insts)});
+    return ISAModule{std::move(insts)};
   }
 
   case Flags::FIBONACCI: {
-    return std::move(ISAModule{{
+    return ISAModule{{
         INST(ADD, rf, r0, r0),  // rf = 0x0
         INST(ADD, r2, r1, r1),  // r2 = 0x2
         INST(LD, re, rf, r0),   // load loop addr
@@ -246,11 +246,72 @@ static auto getISAModule(benchmark::Flags flag) -> shisa::ISAModule {
         INST(ST, r0, r5, ra),   // store arr[i]
         INST(RET, r0, r0, r0),  //
         INST(NOT, r0, r0, r0),  //
-    }});
+    }};
   }
 
+  case Flags::MEMORY_COPY:
+    return ISAModule{{
+        INST(ADD, rf, r0, r0), // rf = 0x0
+        INST(ADD, r2, r1, r1), //
+        INST(LD, re, rf, r0),  // load inner loop addr
+        INST(ADD, rf, rf, r2), // rf =  0x2
+        INST(LD, rd, rf, r0),  // load outer loop addr
+        INST(ADD, rf, rf, r2), // rf =  0x4
+        INST(LD, rb, rf, r0),  // load src addr
+        INST(ADD, rf, rf, r2), // rf =  0x6
+        INST(LD, ra, rf, r0),  // load dst addr
+        INST(ADD, rf, rf, r2), // rf =  0x8
+        INST(LD, rc, rf, r0),  // load src end addr
+        INST(ADD, rf, rf, r2), // rf =  0xa
+        INST(LD, r5, rf, r0),  // load n copies
+        INST(ADD, rf, rf, r2), // rf =  0xc
+        INST(LD, r3, rf, r0),  // load end addr
+        INST(ADD, r6, rb, r0), // outer loop
+        INST(ADD, r7, ra, r0), //
+        INST(LD, r8, r6, r0),  // inner loop
+        INST(ST, r0, r7, r8),  //
+        INST(ADD, r6, r6, r2), //
+        INST(ADD, r7, r7, r2), //
+        INST(LD, r8, r6, r0),  //
+        INST(ST, r0, r7, r8),  //
+        INST(ADD, r6, r6, r2), //
+        INST(ADD, r7, r7, r2), //
+        INST(CMP, r9, r6, rc), //
+        INST(XOR, r9, r9, r1), //
+        INST(JTR, r0, r9, re), // inner loop jump
+        INST(ADD, r4, r4, r1), //
+        INST(CMP, r9, r4, r5), //
+        INST(XOR, r9, r9, r1), //
+        INST(JTR, r0, r9, rd), // outer loop jump
+        INST(JTR, r0, r0, r3), // jump to end
+    }};
+
+  case Flags::PUSH_POP_IN_LOOP:
+    return ISAModule{{
+        INST(ADD, rf, r0, r0), // rf = 0x0
+        INST(ADD, r2, r1, r1), //
+        INST(LD, re, rf, r0),  // load loop addr
+        INST(ADD, rf, rf, r2), // rf =  0x2
+        INST(LD, r5, rf, r0),  // load n loops
+        INST(ADD, rf, rf, r2), // rf =  0x4
+        INST(LD, rd, rf, r0),  // load end addr
+        INST(PUSH, r0, r5, r0), // loop
+        INST(PUSH, r0, r4, r0), //
+        INST(PUSH, r0, r5, r0), //
+        INST(PUSH, r0, r4, r0), //
+        INST(POP, r6, r0, r0),  //
+        INST(POP, r7, r0, r0),  //
+        INST(POP, r8, r0, r0),  //
+        INST(POP, r9, r0, r0),  //
+        INST(ADD, r4, r4, r1),  //
+        INST(CMP, ra, r4, r5),  //
+        INST(XOR, ra, ra, r1),  //
+        INST(JTR, r0, ra, re),  // loop jump
+        INST(JTR, r0, r0, rd),  // jump to end
+    }};
+
   default:
-    return std::move(ISAModule{{}});
+    return ISAModule{};
   }
 }
 
@@ -262,34 +323,34 @@ static auto getBinData(benchmark::Flags flag) -> shisa::Binary::BinaryData {
 
   switch (flag) {
   case Flags::ONLY_NOPS: {
-    return std::move(BinaryData{{}});
+    return BinaryData{};
   }
 
   case Flags::ONE_LOOP: {
     constexpr Data nLoops   = 0xffff;
     constexpr Data loopAddr = 0x000e;
-    return std::move(BinaryData{{
+    return BinaryData{{
         nLoops,
         loopAddr,
-    }});
+    }};
   }
 
   case Flags::ONE_LONG_LOOP: {
     constexpr Data nLoops   = 0xffff;
     constexpr Data loopAddr = 0x000e;
-    return std::move(BinaryData{{
+    return BinaryData{{
         nLoops,
         loopAddr,
-    }});
+    }};
   }
 
   case Flags::NESTED_LOOPS: {
     constexpr Data nLoops   = 0x3fff;
     constexpr Data loopAddr = 0x000e;
-    return std::move(BinaryData{{
+    return BinaryData{{
         nLoops,
         loopAddr,
-    }});
+    }};
   }
 
   case Flags::FUNCTION_IN_LOOP: {
@@ -299,14 +360,14 @@ static auto getBinData(benchmark::Flags flag) -> shisa::Binary::BinaryData {
     constexpr Data nLoops      = 0xffff;
     constexpr Data funcRetAddr = 0x8002;
     constexpr Data instEnd     = 0x0050;
-    return std::move(BinaryData{{
+    return BinaryData{{
         loopAddr,    // 0x0
         funcAddr,    // 0x2
         funcArgAddr, // 0x4
         nLoops,      // 0x6
         funcRetAddr, // 0x8
         instEnd,     // 0xa
-    }});
+    }};
   }
 
   case Flags::FUNCTION_WITH_NOPS_IN_LOOP: {
@@ -316,14 +377,14 @@ static auto getBinData(benchmark::Flags flag) -> shisa::Binary::BinaryData {
     constexpr Data nLoops      = 0xffff;
     constexpr Data funcRetAddr = 0xfffe;
     constexpr Data instEnd     = 0xeff6;
-    return std::move(BinaryData{{
+    return BinaryData{{
         loopAddr,    // 0x0
         funcAddr,    // 0x2
         funcArgAddr, // 0x4
         nLoops,      // 0x6
         funcRetAddr, // 0x8
         instEnd,     // 0xa
-    }});
+    }};
   }
 
   case Flags::FIBONACCI: {
@@ -334,7 +395,7 @@ static auto getBinData(benchmark::Flags flag) -> shisa::Binary::BinaryData {
     constexpr Data fibArray    = 0x10000 - cellsPerData * (n + 1);
     constexpr Data funcJmp     = 0x0058;
     constexpr Data instEnd     = 0x006c;
-    return std::move(BinaryData{{
+    return BinaryData{{
         loopAddr,    // 0x0
         n,           // 0x2
         funcAddr,    // 0x4
@@ -342,16 +403,44 @@ static auto getBinData(benchmark::Flags flag) -> shisa::Binary::BinaryData {
         fibArray,    // 0x8
         funcJmp,     // 0xa
         instEnd,     // 0xc
-    }});
+    }};
   }
 
+  case Flags::MEMORY_COPY: {
+    constexpr Data innerLoopAddr = 0x0030;
+    constexpr Data outerLoopAddr = 0x002c;
+    constexpr Data srcAddr       = 0x8000;
+    constexpr Data dstAddr       = 0xa000;
+    constexpr Data srcEndAddr    = 0xa000;
+    constexpr Data nCopies       = 0x0100;
+    constexpr Data instEnd       = 0x0050;
+    return BinaryData{{
+        innerLoopAddr, // 0x0
+        outerLoopAddr, // 0x2
+        srcAddr,       // 0x4
+        dstAddr,       // 0x6
+        srcEndAddr,    // 0x8
+        nCopies,       // 0xa
+        instEnd,       // 0xc
+    }};
+  }
+
+  case Flags::PUSH_POP_IN_LOOP: {
+    constexpr Data loopAddr = 0x0014;
+    constexpr Data nLoops   = 0xffff;
+    constexpr Data instEnd  = 0x002e;
+    return BinaryData{{
+        loopAddr, // 0x0
+        nLoops,   // 0x2
+        instEnd,  // 0x4
+    }};
+  }
 
   default:
-    return std::move(BinaryData{{}});
+    return BinaryData{};
   }
 }
 
 auto benchmark::getBenchmarkBinary(Flags flag) -> shisa::Binary {
-  return std::move(shisa::Binary{std::move(getISAModule(flag)),
-                                 std::move(getBinData(flag))});
+  return shisa::Binary{getISAModule(flag), getBinData(flag)};
 }
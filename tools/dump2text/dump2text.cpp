@@ -0,0 +1,29 @@
+#include <FunctionalSim/StateDump.hpp>
+
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+
+
+// Prints a binary state dump, written by CpuBase::dumpBinary(), as text.
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " <binary state dump>\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    std::ifstream in{argv[1], std::ios::binary};
+    if (!in) {
+      std::cerr << argv[0] << ": cannot open " << argv[1] << "\n";
+      return EXIT_FAILURE;
+    }
+    shisa::fsim::writeText(std::cout, shisa::fsim::readBinary(in));
+  } catch (const std::exception &e) {
+    std::cerr << argv[0] << ": " << argv[1] << ": " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}